@@ -92,13 +92,19 @@
 // }
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <sys/ioctl.h>
+#include <sys/wait.h>
 #include "../driver/buf_ioctl.h"
+#include "../driver/libbuf.h"
 
 #define DEVICE_PATH "/dev/buf0"
+#define BENCH_ITEMS (1 << 20) // items moved per ring size in --bench
+#define LIBBENCH_ITEMS (1 << 20) // items moved per transport in --libbench
 
 // Function to read 2 unsigned short values
 void read_data(int fd) {
@@ -134,6 +140,7 @@ void write_data(int fd) {
 // Function to handle IOCTL queries
 void ioctl_test(int fd) {
     int value;
+    struct buf_stats stats;
 
     // Number of data items in the buffer
     if (ioctl(fd, BUF_IOCGETNUMDATA, &value) == 0)
@@ -153,6 +160,21 @@ void ioctl_test(int fd) {
     else
         perror("BUF_IOCGETBUFSIZE failed");
 
+    // Device statistics
+    if (ioctl(fd, BUF_IOCGETSTATS, &stats) == 0) {
+        printf("Packed storage: %s, compression ratio: %u.%02u (%llu -> %llu bytes)\n",
+               stats.packed ? "on" : "off", stats.comp_ratio_x100 / 100, stats.comp_ratio_x100 % 100,
+               (unsigned long long)stats.raw_bytes, (unsigned long long)stats.packed_bytes);
+        printf("Writer blocks: %u, auto-sizing: %u grow(s), %u shrink(s), last size %u\n",
+               stats.writer_blocks, stats.auto_grows, stats.auto_shrinks, stats.auto_lastsize);
+        printf("Busy-poll: %u hit(s), %u miss(es)\n", stats.spin_hits, stats.spin_misses);
+        printf("Write-behind: %u pending, %u overflow(s), %u lost, %u drain(s)\n",
+               stats.wb_pending, stats.wb_overflows, stats.wb_lost, stats.wb_drains);
+        printf("Rate limit: %u throttle(s), %u refusal(s), %llu us waited\n", stats.rl_throttled,
+               stats.rl_refused, (unsigned long long)stats.rl_wait_ns / 1000);
+    } else
+        perror("BUF_IOCGETSTATS failed");
+
     // Optionally resize the buffer
     printf("Enter new buffer size (0 to skip): ");
     if (scanf("%d", &value) != 1) { while(getchar() != '\n'); return; }
@@ -164,11 +186,194 @@ void ioctl_test(int fd) {
     }
 }
 
-int main() {
+static int set_size(int fd, int size) {
+    return ioctl(fd, BUF_IOCSETBUFSIZE, &size) == 0 ? 0 : -errno;
+}
+
+// Empty the ring so that every measurement starts from a known state
+static void drain(int fd) {
+    unsigned short data[256];
+    while (read(fd, data, sizeof(data)) > 0)
+        ;
+}
+
+static double elapsed_ns(struct timespec *t0, struct timespec *t1) {
+    return (t1->tv_sec - t0->tv_sec) * 1e9 + (t1->tv_nsec - t0->tv_nsec);
+}
+
+// Enqueue/dequeue cost per item for several ring sizes (needs root for BUF_IOCSETBUFSIZE)
+int run_bench(void) {
+    static const int sizes[] = { 64, 256, 4096, 65536 };
+    unsigned short *data;
+    struct timespec t0, t1;
+    double wr_ns, rd_ns;
+    int fd, oldsize, s, batch, moved;
+
+    fd = open(DEVICE_PATH, O_RDWR | O_NONBLOCK);
+    if (fd < 0) { perror("Open failed"); return 1; }
+    if (ioctl(fd, BUF_IOCGETBUFSIZE, &oldsize) < 0) { perror("BUF_IOCGETBUFSIZE failed"); close(fd); return 1; }
+    data = calloc(65536, sizeof(unsigned short));
+    if (!data) { close(fd); return 1; }
+    drain(fd);
+
+    printf("%10s %10s %14s %14s\n", "ring size", "batch", "enqueue ns/it", "dequeue ns/it");
+    for (s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        if (set_size(fd, sizes[s]) < 0) { perror("BUF_IOCSETBUFSIZE failed"); break; }
+        // Half a ring per syscall, so every batch fits
+        batch = sizes[s] / 2;
+        wr_ns = rd_ns = 0;
+        for (moved = 0; moved < BENCH_ITEMS; moved += batch) {
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            write(fd, data, batch * sizeof(unsigned short));
+            clock_gettime(CLOCK_MONOTONIC, &t1);
+            wr_ns += elapsed_ns(&t0, &t1);
+            read(fd, data, batch * sizeof(unsigned short));
+            clock_gettime(CLOCK_MONOTONIC, &t0);
+            rd_ns += elapsed_ns(&t1, &t0);
+        }
+        printf("%10d %10d %14.1f %14.1f\n", sizes[s], batch, wr_ns / moved, rd_ns / moved);
+    }
+
+    set_size(fd, oldsize);
+    free(data);
+    close(fd);
+    return 0;
+}
+
+// One producer process and one consumer process move LIBBENCH_ITEMS items; returns items/s
+static double libbench_run(int use_lib) {
+    unsigned short data[2] = { 0, 0 };
+    struct buf_writer *w;
+    struct buf_reader *r;
+    struct timespec t0, t1;
+    pid_t pid;
+    int fd, moved;
+    ssize_t n;
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    pid = fork();
+    if (pid < 0) { perror("fork failed"); return 0; }
+    if (pid == 0) {
+        // Producer
+        if (use_lib) {
+            w = buf_writer_open(DEVICE_PATH, 0, 0, 0);
+            if (!w) _exit(1);
+            for (moved = 0; moved < LIBBENCH_ITEMS; moved++)
+                buf_writer_put(w, moved);
+            _exit(buf_writer_close(w) < 0);
+        }
+        fd = open(DEVICE_PATH, O_WRONLY);
+        if (fd < 0) _exit(1);
+        for (moved = 0; moved < LIBBENCH_ITEMS; moved += 2)
+            write(fd, data, sizeof(data));
+        close(fd);
+        _exit(0);
+    }
+
+    // Consumer
+    if (use_lib) {
+        r = buf_reader_open(DEVICE_PATH, 0, 0);
+        for (moved = 0; r && moved < LIBBENCH_ITEMS; moved++)
+            if (buf_reader_get(r, data) < 0) break;
+        if (r) buf_reader_close(r);
+    } else {
+        fd = open(DEVICE_PATH, O_RDONLY);
+        for (moved = 0; fd >= 0 && moved < LIBBENCH_ITEMS; moved += n / sizeof(unsigned short))
+            if ((n = read(fd, data, sizeof(data))) <= 0) break;
+        if (fd >= 0) close(fd);
+    }
+    waitpid(pid, NULL, 0);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    if (moved < LIBBENCH_ITEMS) { printf("consumer stopped after %d items\n", moved); return 0; }
+    return moved / (elapsed_ns(&t0, &t1) / 1e9);
+}
+
+// Warm restart: save the ring contents to a file before rmmod, restore them after insmod
+int run_export(const char *path) {
+    void *image;
+    size_t len;
+    FILE *f;
+    int fd, ret = 1;
+
+    fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) { perror("Open failed"); return 1; }
+    image = buf_export(fd, &len);
+    close(fd);
+    if (!image) { perror("BUF_IOCEXPORT failed"); return 1; }
+    f = fopen(path, "wb");
+    if (f && fwrite(image, 1, len, f) == len) {
+        printf("Exported %zu bytes to %s\n", len, path);
+        ret = 0;
+    } else {
+        perror(path);
+    }
+    if (f && fclose(f) != 0) { perror(path); ret = 1; }
+    free(image);
+    return ret;
+}
+
+int run_import(const char *path) {
+    void *image;
+    long len;
+    FILE *f;
+    int fd, ret = 1;
+
+    f = fopen(path, "rb");
+    if (!f) { perror(path); return 1; }
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    image = malloc(len > 0 ? len : 1);
+    if (!image || fread(image, 1, len, f) != (size_t)len) {
+        perror(path);
+        fclose(f);
+        free(image);
+        return 1;
+    }
+    fclose(f);
+    // Opened read-only so that a writer already attached does not make the open fail
+    fd = open(DEVICE_PATH, O_RDONLY | O_NONBLOCK);
+    if (fd < 0) { perror("Open failed"); free(image); return 1; }
+    if (buf_import(fd, image, len) == 0) {
+        printf("Imported %ld bytes from %s\n", len, path);
+        ret = 0;
+    } else {
+        perror("BUF_IOCIMPORT failed");
+    }
+    close(fd);
+    free(image);
+    return ret;
+}
+
+// Producer/consumer throughput: 2 items per syscall against the batched libbuf API
+int run_libbench(void) {
+    double naive, lib;
+
+    naive = libbench_run(0);
+    lib = libbench_run(1);
+    printf("%-22s %14.0f items/s\n", "read()/write() 2 items", naive);
+    printf("%-22s %14.0f items/s\n", "libbuf", lib);
+    if (naive > 0)
+        printf("speedup: %.1fx\n", lib / naive);
+    return naive <= 0 || lib <= 0;
+}
+
+int main(int argc, char *argv[]) {
     int fd = -1;
     int choice, mode;
     int access;
 
+    // Non-interactive modes: speed of the ring and of libbuf (correctness: KUnit suite, see readme)
+    if (argc > 1 && strcmp(argv[1], "--bench") == 0)
+        return run_bench();
+    if (argc > 1 && strcmp(argv[1], "--libbench") == 0)
+        return run_libbench();
+    // Warm restart across a module reload
+    if (argc > 2 && strcmp(argv[1], "--export") == 0)
+        return run_export(argv[2]);
+    if (argc > 2 && strcmp(argv[1], "--import") == 0)
+        return run_import(argv[2]);
+
     while (1) {
         printf("\n--- BUF DRIVER TEST ---\n");
         printf("1. Read\n");
@@ -12,6 +12,18 @@
 #include <linux/device.h>
 #include <linux/uaccess.h>
 #include <linux/capability.h>  // for capable()
+#include <linux/list.h>
+#include <linux/bitops.h>  // fls(), hweight32()
+#include <linux/math64.h>  // div64_u64()
+#include <linux/overflow.h>  // check_add_overflow() : image sizes
+#include <linux/jiffies.h>  // auto-sizing windows
+#include <linux/moduleparam.h>
+#include <linux/ktime.h>  // ktime_get_ns() : busy-poll budget
+#include <linux/sched/signal.h>  // signal_pending(), need_resched()
+#include <linux/atomic.h>
+#include <linux/workqueue.h>  // write-behind drain
+#include <linux/hrtimer.h>  // schedule_hrtimeout_range() : rate limiting
+#include <linux/io_uring/cmd.h>  // io_uring passthrough (struct io_uring_cmd)
 
 #include "buf_ioctl.h"
 
@@ -19,6 +31,11 @@
 
 #define READWRITE_BUFSIZE 16
 #define DEFAULT_BUFSIZE 256
+#define BUF_PACK_BLOCK 64 /* items par bloc compressé */
+#define BUF_PACK_HDRSIZE 4 /* en-tête d'un bloc : nombre, largeur, première valeur */
+#define BUF_PACK_MAXBLOCK (BUF_PACK_HDRSIZE + (BUF_PACK_BLOCK - 1) * sizeof(unsigned short)) /* pire cas (octets) */
+#define BUF_PACK_MINSIZE BUF_PACK_BLOCK /* BufSize minimal en mode compressé */
+#define BUF_AGG_BUFSIZE 256 /* taille du tampon de sortie d'un lecteur en mode réduit (unsigned short) */
 
 MODULE_LICENSE("Dual BSD/GPL");
 MODULE_AUTHOR("Anis Chabi");
@@ -28,6 +45,11 @@ MODULE_DESCRIPTION("Pilote ring buffer - ELE784 Lab3");
 int buf_major = 0;  // 0 means dynamic allocation
 int buf_minor = 0;  // starting minor number
 
+/* Budget d'attente active par défaut (us), modifiable dans /sys/module/buf_driver/parameters */
+unsigned int busy_poll = 0;
+module_param(busy_poll, uint, 0644);
+MODULE_PARM_DESC(busy_poll, "Default busy-poll budget in us before sleeping (0 = off)");
+
 
 /* Déclarations des fonctions du pilote */
 int buf_init(void);
@@ -37,10 +59,13 @@ int buf_release(struct inode *inode, struct file *filp);
 ssize_t buf_read(struct file *filp, char __user *ubuf,size_t count, loff_t *f_pos);
 ssize_t buf_write(struct file *filp, const char __user *ubuf,size_t count, loff_t *f_pos);
 long buf_ioctl(struct file *filp, unsigned int cmd, unsigned long arg);
+int buf_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+loff_t buf_llseek(struct file *filp, loff_t off, int whence);
+int buf_fsync(struct file *filp, loff_t start, loff_t end, int datasync);
 module_init(buf_init);
 module_exit(buf_exit);
 
-/* Structure du tampon circulaire */
+/* Structure du tampon circulaire (une par voie de priorité) */
 struct BufStruct {
   unsigned int InIdx; /* Index d'écriture */
   unsigned int OutIdx; /* Index de lecture */
@@ -48,22 +73,94 @@ struct BufStruct {
   unsigned short BufEmpty; /* Drapeau: tampon vide */
   unsigned int BufSize; /* Taille du tampon */
   unsigned short *Buffer; /* Pointeur vers les données */
-} Buffer;
+  unsigned int HighWater; /* Occupation maximale observée */
+  unsigned int WinHigh; /* Occupation maximale dans la fenêtre d'auto-dimensionnement courante */
+  unsigned int Blocks; /* Écrivains ayant trouvé la voie pleine dans la fenêtre courante */
+  unsigned int LowWins; /* Fenêtres consécutives à faible occupation */
+  unsigned long long InSeq; /* Numéro de séquence de la prochaine donnée écrite */
+  unsigned short Retain; /* Drapeau: conserver les données lues jusqu'à leur écrasement */
+  unsigned int Retained; /* Données déjà lues conservées juste avant OutIdx */
+  /* Mode compressé : Buffer sert de réserve d'octets (BufSize * 2) pour des blocs delta + bit-packing */
+  unsigned short Packed; /* Drapeau: stockage compressé */
+  unsigned int NumItems; /* Nombre logique de données (mode compressé) */
+  unsigned int PoolHead; /* Octet du plus ancien bloc */
+  unsigned int PoolTail; /* Octet du prochain bloc */
+  unsigned int PoolUsed; /* Octets occupés par les blocs */
+  unsigned short Stage[BUF_PACK_BLOCK]; /* Bloc en cours d'écriture (non compressé) */
+  unsigned int StageIn, StageOut; /* Indices d'écriture / lecture dans Stage */
+  unsigned short Cache[BUF_PACK_BLOCK]; /* Plus ancien bloc décompressé */
+  unsigned int CacheIn, CacheOut; /* Indices d'écriture / lecture dans Cache */
+  unsigned long long RawBytes; /* Octets bruts compressés depuis l'activation */
+  unsigned long long PackedBytes; /* Octets des blocs produits depuis l'activation */
+};
+
+/* Seau à jetons limitant le débit d'écriture (device ou ouverture) */
+// Tokens are counted in item-nanoseconds (1 item = NSEC_PER_SEC) so that refilling at Rate items/s
+// stays exact in integers. An io_uring batch larger than Burst may leave the bucket in debt.
+struct BufBucket {
+  unsigned int Rate; /* Données par seconde (0 = illimité) */
+  unsigned int Burst; /* Capacité du seau (données) */
+  s64 Tokens; /* Jetons disponibles (données * NSEC_PER_SEC), négatif = dette */
+  u64 Last; /* Dernier remplissage (ktime_get_ns) */
+};
 
 /* Structure du dispositif */
 struct Buf_Dev {
   unsigned short *ReadBuf; /* Tampon local lecture */
-  unsigned short *WriteBuf; /* Tampon local écriture */
   struct semaphore SemBuf; /* Sémaphore de protection */
   wait_queue_head_t InQueue; /* File attente écriture */
   wait_queue_head_t OutQueue; /* File attente lecture */
   unsigned short numWriter; /* Nombre d'écrivains */
+  unsigned int WriterLanes; /* Voies choisies par les écrivains ouverts (un bit par voie) */
   unsigned short numReader; /* Nombre de lecteurs */
   dev_t dev; /* Numéro de device  (major,minor)*/ 
   struct cdev cdev; /* Structure cdev (Character device structure) */
   struct class *class; /* Classe du device :  Device class (/sys/class)*/
+  struct list_head UringRd; /* Commandes io_uring DEQUEUE en attente de données */
+  struct list_head UringWr; /* Commandes io_uring ENQUEUE en attente d'espace */
+  struct list_head Taps; /* Ouvertures en mode de lecture réduit (struct Buf_File) */
+  struct BufStruct Lanes[BUF_MAX_LANES]; /* Voies de priorité : Lanes[0] est la plus prioritaire */
+  unsigned int NumLanes; /* Nombre de voies de priorité actives */
+  struct buf_autosize Auto; /* Politique d'auto-dimensionnement (désactivée par défaut) */
+  unsigned long AutoWinEnd; /* Fin de la fenêtre d'observation courante (jiffies) */
+  struct delayed_work AutoWork; /* Ferme les fenêtres même sans trafic (politique active) */
+  unsigned int WriterBlocks; /* Écrivains ayant trouvé leur voie pleine */
+  unsigned int AutoGrows, AutoShrinks; /* Décisions de la politique */
+  unsigned int AutoLastSize; /* Taille choisie par la dernière décision */
+  atomic_t SpinHits, SpinMisses; /* Attentes actives réussies / terminées sur la file d'attente */
+  struct list_head Behind; /* Ouvertures en mode write-behind (struct Buf_File) */
+  unsigned int WbOverflows; /* Données refusées, file d'attente pleine (toutes ouvertures) */
+  unsigned int WbLost; /* Données en attente perdues à la fermeture */
+  unsigned int WbDrains; /* Exécutions du travail de vidage */
+  struct BufBucket Rate; /* Limite de débit commune à tous les écrivains (admin) */
+  unsigned int RlThrottled; /* Écrivains endormis faute de jetons */
+  unsigned int RlRefused; /* Écritures écourtées ou refusées faute de jetons (O_NONBLOCK) */
+  u64 RlWaitNs; /* Attente totale demandée par la limite de débit (ns) */
 } BDev; //The single instance of the buffer character device managed by this driver.
 
+/* Structure propre à chaque ouverture (filp->private_data) */
+struct Buf_File {
+  struct Buf_Dev *dev; /* Device partagé */
+  unsigned int Lane; /* Voie de priorité des écritures */
+  unsigned short WriteBuf[READWRITE_BUFSIZE]; /* Tampon local écriture (un par écrivain) */
+  int BusyPoll; /* Budget d'attente active (us), -1 = paramètre busy_poll */
+  struct buf_readmode Mode; /* Mode de lecture (BUF_READ_RAW par défaut) */
+  struct list_head TapNode; /* Lien dans BDev.Taps si le mode n'est pas BUF_READ_RAW */
+  unsigned int WinCount; /* Données accumulées dans la fenêtre courante */
+  unsigned short WinFirst, WinMin, WinMax; /* Première valeur, minimum, maximum de la fenêtre */
+  unsigned long WinSum; /* Somme des valeurs de la fenêtre */
+  struct BufStruct Agg; /* Enregistrements réduits en attente de lecture */
+  /* Mode write-behind */
+  struct BufStruct Staged; /* File d'attente des écritures (Buffer NULL = mode désactivé) */
+  struct list_head BehindNode; /* Lien dans BDev.Behind */
+  struct work_struct Drain; /* Travail qui vide Staged dans le ring */
+  wait_queue_head_t FlushQueue; /* Attente de fsync() / BUF_IOCWRFLUSH */
+  unsigned int Overflows; /* Données refusées, Staged plein */
+  /* Limite de débit propre à cette ouverture */
+  struct BufBucket Rate; /* Seau à jetons (Rate 0 = illimité) */
+  unsigned int Throttled, Refused; /* Attentes / refus dus à ce seau ou à celui du device */
+};
+
 
 /* Table des opérations */
 struct file_operations Buf_fops = {
@@ -73,24 +170,94 @@ struct file_operations Buf_fops = {
   .read = buf_read,
   .write = buf_write,
   .unlocked_ioctl = buf_ioctl,
+  .uring_cmd = buf_uring_cmd,
+  .llseek = buf_llseek,
+  .fsync = buf_fsync,
+};
+
+/* Lot io_uring en cours : copie noyau des items d'une commande ENQUEUE/DEQUEUE */
+struct BufUringReq {
+  void __user *UserAddr; /* Tampon utilisateur du lot */
+  unsigned int NumItems; /* Taille du lot (items) */
+  unsigned int Done; /* Items déjà transférés */
+  unsigned int Lane; /* Voie de destination (ENQUEUE) */
+  unsigned short Items[]; /* Copie noyau des items */
+};
+
+/* État d'une commande io_uring en attente, rangé dans ioucmd->pdu */
+struct BufUringPdu {
+  struct list_head node; /* Lien dans BDev.UringRd ou BDev.UringWr */
+  struct BufUringReq *Req; /* Lot associé */
 };
 
 /* Function prototypes */
 int BufIn(struct BufStruct *Buf, unsigned short *Data);
 int BufOut(struct BufStruct *Buf, unsigned short *Data);
+int BufNumData(struct BufStruct *Buf);
+void BufReset(struct BufStruct *Buf);
+int BufResize(struct BufStruct *Buf, unsigned int NewSize);
+int BufPeek(struct BufStruct *Buf, unsigned short *Data, int Count);
+void BufPackReset(struct BufStruct *Buf);
+int BufPackIn(struct BufStruct *Buf, unsigned short *Data);
+int BufPackOut(struct BufStruct *Buf, unsigned short *Data);
+int BufPackFlush(struct BufStruct *Buf);
+int BufPackDecode(struct BufStruct *Buf, unsigned int Pos, unsigned short *Data, unsigned int *Bytes);
+struct BufUringPdu *buf_uring_pdu(struct io_uring_cmd *ioucmd);
+int buf_uring_lock(struct Buf_Dev *dev, unsigned int issue_flags);
+void buf_uring_kick(struct Buf_Dev *dev);
+int buf_enqueue(struct Buf_Dev *dev, unsigned int lane, unsigned short *Data);
+int buf_dequeue(struct Buf_Dev *dev, unsigned short *Data);
+int buf_lanes_empty(struct Buf_Dev *dev);
+int buf_num_data(struct Buf_Dev *dev);
+int buf_lane_taken(struct Buf_Dev *dev, unsigned int lane, unsigned int except);
+int buf_dev_setup(struct Buf_Dev *dev);
+void buf_dev_free(struct Buf_Dev *dev);
+int buf_dev_open(struct Buf_Dev *dev, struct file *filp);
+int buf_set_bufsize(struct Buf_File *bf, int size);
+unsigned int buf_writer_lane(struct Buf_File *bf);
+int buf_autosize(struct Buf_Dev *dev, int lane);
+void buf_autosize_tick(struct work_struct *work);
+int buf_busy_poll(struct Buf_File *bf, int lane);
+ssize_t buf_write_behind(struct file *filp, const char __user *ubuf, size_t count);
+int buf_behind_move(struct Buf_File *bf);
+void buf_behind_drain(struct work_struct *work);
+void buf_behind_kick(struct Buf_Dev *dev);
+int buf_behind_flush(struct Buf_File *bf, int nonblocking);
+int buf_behind_set(struct Buf_File *bf, unsigned int size);
+int buf_export(struct Buf_Dev *dev, struct buf_image *img);
+int buf_import(struct Buf_Dev *dev, struct buf_image *img);
+void buf_bucket_set(struct BufBucket *b, unsigned int rate, unsigned int burst);
+void buf_bucket_refill(struct BufBucket *b, u64 now);
+unsigned int buf_bucket_avail(struct BufBucket *b);
+u64 buf_bucket_wait(struct BufBucket *b, unsigned int need);
+unsigned int buf_rate_allow(struct Buf_File *bf, unsigned int want, u64 *wait_ns);
+u64 buf_rate_batch(struct Buf_File *bf, unsigned int n);
+void buf_rate_take(struct Buf_File *bf, int n);
+int buf_rate_throttle(struct Buf_File *bf, u64 wait_ns, int nonblocking);
+void buf_tap_sample(struct Buf_File *bf, unsigned short Data);
+int buf_set_readmode(struct Buf_File *bf, struct buf_readmode *mode);
+ssize_t buf_read_reduced(struct file *filp, char __user *ubuf, size_t count);
+void buf_uring_rd_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
+void buf_uring_wr_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags);
 
 /* Fonction d'insertion dans le buffer (une donnée à la fois) */
 int BufIn(struct BufStruct *Buf, unsigned short *Data) {
+  if (Buf->Packed)
+    return BufPackIn(Buf, Data);
   //Vérifier si le buffer est plein
   if (Buf->BufFull)
     return -1; // Si le buffer est plein, on ne peut rien ajouter : retourne -1
 
   //Dès qu'on ajoute une donnée, le buffer n'est plus vide 
   Buf->BufEmpty = 0;
+  // Mode rétention : si InIdx atteint la plus ancienne donnée conservée, elle est écrasée
+  if (Buf->Retained && (Buf->OutIdx + Buf->BufSize - Buf->Retained) % Buf->BufSize == Buf->InIdx)
+    Buf->Retained--;
   // Insérer la donnée , Copie la valeur pointée par Data dans le buffer à la position InIdx
   Buf->Buffer[Buf->InIdx] = *Data;
   //Avancer l'index (circulaire) : L'opération % BufSize rend le buffer circulaire !
   Buf->InIdx = (Buf->InIdx + 1) % Buf->BufSize;
+  Buf->InSeq++;
 
   // Vérifier si le buffer est maintenant plein :  Quand le buffer est-il plein ?
   // Quand l'index d'écriture (InIdx) rattrape l'index de lecture (OutIdx)
@@ -102,6 +269,8 @@ int BufIn(struct BufStruct *Buf, unsigned short *Data) {
 
 /* Fonction d'extraction du buffer (une donnée à la fois) */
 int BufOut(struct BufStruct *Buf, unsigned short *Data) {
+  if (Buf->Packed)
+    return BufPackOut(Buf, Data);
   //Vérifier si le buffer est vide
   if (Buf->BufEmpty)
     return -1; //Si le buffer est vide, on ne peut rien lire : retourne -1
@@ -112,6 +281,9 @@ int BufOut(struct BufStruct *Buf, unsigned short *Data) {
   *Data = Buf->Buffer[Buf->OutIdx];
   //Avancer l'index de lecture (circulaire)
   Buf->OutIdx = (Buf->OutIdx + 1) % Buf->BufSize;
+  // Mode rétention : la donnée lue reste disponible pour une relecture (llseek)
+  if (Buf->Retain)
+    Buf->Retained++;
 
   //Vérifier si le buffer est maintenant vide
   if (Buf->OutIdx == Buf->InIdx)
@@ -120,6 +292,305 @@ int BufOut(struct BufStruct *Buf, unsigned short *Data) {
   return 0;
 }
 
+/* Nombre de données présentes dans le buffer */
+int BufNumData(struct BufStruct *Buf) {
+  if (Buf->Packed)
+    return Buf->NumItems;
+  // If the buffer is full, the number of items equals the buffer size.
+  if (Buf->BufFull)
+    return Buf->BufSize;
+  // If not full, it is the difference between InIdx and OutIdx, adjusted for wrap-around using modulo.
+  return (Buf->InIdx - Buf->OutIdx + Buf->BufSize) % Buf->BufSize;
+}
+
+/* Vide le buffer : indices, drapeaux et occupation maximale */
+void BufReset(struct BufStruct *Buf) {
+  Buf->InIdx = 0;
+  Buf->OutIdx = 0;
+  Buf->BufFull = 0;
+  Buf->BufEmpty = 1;
+  Buf->HighWater = 0;
+  Buf->WinHigh = 0;
+  Buf->Blocks = 0;
+  Buf->LowWins = 0;
+  Buf->Retained = 0;
+  BufPackReset(Buf);
+}
+
+/* Change la taille du buffer en conservant les données (appelée avec SemBuf tenu) */
+int BufResize(struct BufStruct *Buf, unsigned int NewSize) {
+  unsigned short *newbuf;
+  int i, ndata, keep;
+
+  // Validate new size
+  // In packed mode the pool layout depends on BufSize, so only an empty ring can be resized
+  if (Buf->Packed && (!Buf->BufEmpty || NewSize < BUF_PACK_MINSIZE))
+    return Buf->BufEmpty ? -EINVAL : -EBUSY;
+  // CALCULATE how many data items are currently in the buffer
+  ndata = BufNumData(Buf);
+  //If the new size is smaller than the number of items already in the buffer, we cannot shrink.
+  if (NewSize == 0 || NewSize < ndata)
+    return -EINVAL;
+
+  //Allocates a new buffer in kernel memory of NewSize items of sizeof(unsigned short)
+  newbuf = kmalloc(NewSize * sizeof(unsigned short), GFP_KERNEL);
+  if (!newbuf)
+    return -ENOMEM;
+  // Retention mode: keep as much of the already-read history as the new size allows
+  keep = min_t(unsigned int, Buf->Retained, NewSize - ndata);
+  // Copy existing data to new buffer, oldest first
+  for (i = 0; i < keep + ndata; i++)
+    newbuf[i] = Buf->Buffer[(Buf->OutIdx + Buf->BufSize - keep + i) % Buf->BufSize];
+  // Free old buffer memory and point to the new one
+  kfree(Buf->Buffer);
+  Buf->Buffer = newbuf;
+  Buf->BufSize = NewSize;
+  // indices are reset: InIdx points to the end of the copied data, OutIdx to the first unread item
+  Buf->InIdx = (keep + ndata) % NewSize;
+  Buf->OutIdx = keep;
+  Buf->Retained = keep;
+  // Update full/empty flags
+  Buf->BufFull = (ndata == NewSize);
+  Buf->BufEmpty = (ndata == 0);
+  if (Buf->Packed)
+    BufPackReset(Buf);
+  return 0;
+}
+
+/* Copie les Count plus anciennes données sans les retirer du buffer */
+int BufPeek(struct BufStruct *Buf, unsigned short *Data, int Count) {
+  unsigned short blk[BUF_PACK_BLOCK];
+  unsigned int pos, used, len;
+  int i, items, n = 0;
+
+  Count = min(Count, BufNumData(Buf));
+  if (!Buf->Packed) {
+    for (i = 0; i < Count; i++)
+      Data[i] = Buf->Buffer[(Buf->OutIdx + i) % Buf->BufSize];
+    return Count;
+  }
+  // Packed mode: same order as BufPackOut() -> decoded cache, stored blocks, then the stage.
+  for (i = Buf->CacheOut; i < Buf->CacheIn && n < Count; i++)
+    Data[n++] = Buf->Cache[i];
+  for (pos = Buf->PoolHead, used = 0; used < Buf->PoolUsed && n < Count; used += len) {
+    items = BufPackDecode(Buf, pos, blk, &len);
+    pos = (pos + len) % (Buf->BufSize * sizeof(unsigned short));
+    for (i = 0; i < items && n < Count; i++)
+      Data[n++] = blk[i];
+  }
+  for (i = Buf->StageOut; i < Buf->StageIn && n < Count; i++)
+    Data[n++] = Buf->Stage[i];
+  return n;
+}
+
+
+/* --- Stockage compressé : blocs delta + bit-packing --- */
+// Block layout in the byte pool (Buf->Buffer seen as BufSize * 2 bytes, blocks may wrap):
+//   byte 0 : number of items n (1..BUF_PACK_BLOCK)
+//   byte 1 : bit width w (0..16) of the zigzag-encoded deltas
+//   byte 2-3 : first value (little endian)
+//   then n-1 deltas of w bits, LSB first, padded to a byte.
+// Deltas are computed modulo 2^16, so decoding is exact for any input.
+
+/* Remet à zéro l'état du mode compressé (buffer vide) */
+void BufPackReset(struct BufStruct *Buf) {
+  Buf->NumItems = 0;
+  Buf->PoolHead = 0;
+  Buf->PoolTail = 0;
+  Buf->PoolUsed = 0;
+  Buf->StageIn = 0;
+  Buf->StageOut = 0;
+  Buf->CacheIn = 0;
+  Buf->CacheOut = 0;
+}
+
+/* Compresse le bloc Stage dans la réserve ; retourne -1 si la place manque */
+int BufPackFlush(struct BufStruct *Buf) {
+  unsigned char *pool = (unsigned char *)Buf->Buffer;
+  unsigned int poolsize = Buf->BufSize * sizeof(unsigned short);
+  unsigned int n = Buf->StageIn - Buf->StageOut;
+  unsigned short *src = &Buf->Stage[Buf->StageOut];
+  unsigned short zz[BUF_PACK_BLOCK];
+  unsigned int i, width = 0, size, pos, acc = 0, nbits = 0;
+  short delta;
+
+  if (n == 0)
+    return 0;
+  // 1. Zigzag-encode the deltas and find the widest one
+  for (i = 1; i < n; i++) {
+    delta = (short)(src[i] - src[i - 1]);
+    zz[i] = (unsigned short)(((unsigned int)delta << 1) ^ (delta >> 15));
+    width = max(width, (unsigned int)fls(zz[i]));
+  }
+  size = BUF_PACK_HDRSIZE + DIV_ROUND_UP((n - 1) * width, 8);
+  if (poolsize - Buf->PoolUsed < size)
+    return -1;
+
+  // 2. Header, then the packed deltas
+  pos = Buf->PoolTail;
+  pool[pos] = n;
+  pool[(pos + 1) % poolsize] = width;
+  pool[(pos + 2) % poolsize] = src[0] & 0xff;
+  pool[(pos + 3) % poolsize] = src[0] >> 8;
+  pos = (pos + BUF_PACK_HDRSIZE) % poolsize;
+  for (i = 1; i < n; i++) {
+    acc |= (unsigned int)zz[i] << nbits;
+    nbits += width;
+    while (nbits >= 8) {
+      pool[pos] = acc & 0xff;
+      pos = (pos + 1) % poolsize;
+      acc >>= 8;
+      nbits -= 8;
+    }
+  }
+  if (nbits > 0) {
+    pool[pos] = acc & 0xff;
+    pos = (pos + 1) % poolsize;
+  }
+
+  // 3. Commit the block
+  Buf->PoolTail = pos;
+  Buf->PoolUsed += size;
+  Buf->RawBytes += n * sizeof(unsigned short);
+  Buf->PackedBytes += size;
+  Buf->StageIn = 0;
+  Buf->StageOut = 0;
+  return 0;
+}
+
+/* Décompresse le bloc situé à l'octet Pos ; retourne le nombre d'items et sa taille dans *Bytes */
+int BufPackDecode(struct BufStruct *Buf, unsigned int Pos, unsigned short *Data, unsigned int *Bytes) {
+  unsigned char *pool = (unsigned char *)Buf->Buffer;
+  unsigned int poolsize = Buf->BufSize * sizeof(unsigned short);
+  unsigned int n = pool[Pos];
+  unsigned int width = pool[(Pos + 1) % poolsize];
+  unsigned int i, acc = 0, nbits = 0;
+  unsigned short zz;
+
+  Data[0] = pool[(Pos + 2) % poolsize] | (pool[(Pos + 3) % poolsize] << 8);
+  Pos = (Pos + BUF_PACK_HDRSIZE) % poolsize;
+  for (i = 1; i < n; i++) {
+    while (nbits < width) {
+      acc |= (unsigned int)pool[Pos] << nbits;
+      Pos = (Pos + 1) % poolsize;
+      nbits += 8;
+    }
+    zz = acc & ((1u << width) - 1);
+    acc >>= width;
+    nbits -= width;
+    Data[i] = Data[i - 1] + (unsigned short)((zz >> 1) ^ -(zz & 1));
+  }
+  *Bytes = BUF_PACK_HDRSIZE + DIV_ROUND_UP((n - 1) * width, 8);
+  return n;
+}
+
+/* BufIn() en mode compressé */
+int BufPackIn(struct BufStruct *Buf, unsigned short *Data) {
+  if (Buf->BufFull)
+    return -1;
+
+  Buf->BufEmpty = 0;
+  Buf->Stage[Buf->StageIn++] = *Data;
+  Buf->NumItems++;
+  Buf->InSeq++;
+  // Pack the block as soon as it is complete; if the pool has no room, the stage stays full
+  // and the buffer is full until a reader frees a block.
+  if (Buf->StageIn == BUF_PACK_BLOCK)
+    BufPackFlush(Buf);
+  Buf->BufFull = (Buf->StageIn == BUF_PACK_BLOCK);
+  return 0;
+}
+
+/* BufOut() en mode compressé */
+int BufPackOut(struct BufStruct *Buf, unsigned short *Data) {
+  unsigned int len;
+
+  if (Buf->BufEmpty)
+    return -1;
+
+  // Oldest data first: decoded cache, then the oldest stored block, then the stage.
+  if (Buf->CacheOut == Buf->CacheIn && Buf->PoolUsed > 0) {
+    Buf->CacheIn = BufPackDecode(Buf, Buf->PoolHead, Buf->Cache, &len);
+    Buf->CacheOut = 0;
+    Buf->PoolHead = (Buf->PoolHead + len) % (Buf->BufSize * sizeof(unsigned short));
+    Buf->PoolUsed -= len;
+  }
+  if (Buf->CacheOut < Buf->CacheIn) {
+    *Data = Buf->Cache[Buf->CacheOut++];
+  } else {
+    *Data = Buf->Stage[Buf->StageOut++];
+    if (Buf->StageOut == Buf->StageIn)
+      Buf->StageIn = Buf->StageOut = 0;
+  }
+  Buf->NumItems--;
+
+  // A freed block may make room for a stage that could not be packed
+  if (Buf->StageIn == BUF_PACK_BLOCK)
+    BufPackFlush(Buf);
+  Buf->BufFull = (Buf->StageIn == BUF_PACK_BLOCK);
+  Buf->BufEmpty = (Buf->NumItems == 0);
+  return 0;
+}
+
+
+/* Initialise l'état d'un device : une voie de DEFAULT_BUFSIZE, sémaphore, files d'attente, listes */
+// Used by buf_init() for BDev and by the KUnit tests for their own devices. Returns 0 or -ENOMEM.
+int buf_dev_setup(struct Buf_Dev *dev) {
+  // --- Initialize the Buffer structure: one lane until BUF_IOCSETLANES ---
+  BufReset(&dev->Lanes[0]);
+  dev->Lanes[0].BufSize = DEFAULT_BUFSIZE;
+  dev->Lanes[0].Packed = 0;  // raw storage until BUF_IOCSETPACKED
+  //Allocate memory for the actual storage of the buffer.
+  dev->Lanes[0].Buffer = kmalloc(dev->Lanes[0].BufSize * sizeof(unsigned short), GFP_KERNEL);
+  // Check if the memory allocation failed.
+  if (!dev->Lanes[0].Buffer) { //If kmalloc returns NULL, allocation failed (not enough memory).
+      // standard Linux error code for "out of memory"
+      printk(KERN_WARNING "buf : (buf_dev_setup) memory allocation error for Lanes[0].Buffer\n");
+      return -ENOMEM;
+  }
+
+  // --- Initialize the device structure ---
+  //Initializes the semaphore SemBuf inside the device. 1 means it’s a binary semaphore (can act like a mutex)
+  sema_init(&dev->SemBuf, 1); 
+  //initializes the wait queues for reading/writing.
+  init_waitqueue_head(&dev->InQueue); // processes waiting to write when the buffer is full.
+  init_waitqueue_head(&dev->OutQueue); // processes waiting to read when the buffer is empty.
+  // initialize counters for the number of readers/writers currently using the device.
+  // Useful for bookkeeping and possibly for multi-process access management.
+  dev->numReader = 0;
+  dev->numWriter = 0;
+  // Lists of io_uring commands parked until the ring has data (UringRd) or space (UringWr)
+  INIT_LIST_HEAD(&dev->UringRd);
+  INIT_LIST_HEAD(&dev->UringWr);
+  // Readers that asked for a reduced stream (BUF_IOCSETREADMODE)
+  INIT_LIST_HEAD(&dev->Taps);
+  // Writers in write-behind mode, drained when readers free space
+  INIT_LIST_HEAD(&dev->Behind);
+  // Auto-sizing windows also close on an idle device
+  INIT_DELAYED_WORK(&dev->AutoWork, buf_autosize_tick);
+  dev->NumLanes = 1;
+  // Busy-poll counters (BUF_IOCGETSTATS)
+  atomic_set(&dev->SpinHits, 0);
+  atomic_set(&dev->SpinMisses, 0);
+
+  //  Initialize ReadBuf to NULL (lazy allocation); each writer has its own WriteBuf
+  dev->ReadBuf = NULL;   // Will be allocated in buf_read() if needed
+  return 0;
+}
+
+/* Libère la mémoire d'un device (voies, tampons locaux) après l'arrêt de son travail d'auto-dimensionnement */
+void buf_dev_free(struct Buf_Dev *dev) {
+  int lane;
+
+  dev->Auto.enable = 0;
+  cancel_delayed_work_sync(&dev->AutoWork);
+  for (lane = 0; lane < BUF_MAX_LANES; lane++) {
+    kfree(dev->Lanes[lane].Buffer);
+    dev->Lanes[lane].Buffer = NULL;
+  }
+  kfree(dev->ReadBuf);
+  dev->ReadBuf = NULL;
+}
 
 int buf_init(void) {
   //If you set scull_major manually (e.g., in module parameters),
@@ -151,41 +622,17 @@ int buf_init(void) {
     return result;
   }
 
-  // --- Initialize the Buffer structure ---
-  Buffer.InIdx = 0;
-  Buffer.OutIdx = 0;
-  Buffer.BufFull = 0;
-  Buffer.BufEmpty = 1;
-  Buffer.BufSize = DEFAULT_BUFSIZE;
-  //Allocate memory for the actual storage of the buffer.
-  Buffer.Buffer = kmalloc(Buffer.BufSize * sizeof(unsigned short), GFP_KERNEL);
-  // Check if the memory allocation failed.
-  if (!Buffer.Buffer) { //If kmalloc returns NULL, allocation failed (not enough memory).
+  // --- Initialize the device state: one lane until BUF_IOCSETLANES, semaphore, wait queues, lists ---
+  result = buf_dev_setup(&BDev);
+  if (result) {
       //We clean up by unregistering the device numbers
       unregister_chrdev_region(devno, 1);
-      // standard Linux error code for "out of memory"
-      printk(KERN_WARNING "buf : (buf_init) memory allocation error for Buffer.Buffer\n");
-      return -ENOMEM;
+      return result;
   }
-
-  // --- Initialize BDev structure ---
-  //Initializes the semaphore SemBuf inside BDev. 1 means it’s a binary semaphore (can act like a mutex)
-  sema_init(&BDev.SemBuf, 1); 
-  //initializes the wait queues for reading/writing.
-  init_waitqueue_head(&BDev.InQueue); // processes waiting to write when the buffer is full.
-  init_waitqueue_head(&BDev.OutQueue); // processes waiting to read when the buffer is empty.
-  // initialize counters for the number of readers/writers currently using the device.
-  // Useful for bookkeeping and possibly for multi-process access management.
-  BDev.numReader = 0;
-  BDev.numWriter = 0;
   //Stores the device number (major + minor) that was allocated or registered earlier in the BDev structure.
   //This is used later when creating the cdev and device in /dev.
   BDev.dev = devno;
 
-  //  Initialize ReadBuf and WriteBuf to NULL (lazy allocation)
-  BDev.ReadBuf = NULL;   // Will be allocated in buf_read() if needed
-  BDev.WriteBuf = NULL;  // Will be allocated in buf_write() if needed
-
 
   // --- Create device class. Purpose: Prepare the kernel infrastructure so /dev/buf0 can exist.---
   //Creates a device class in the kernel.
@@ -197,7 +644,7 @@ int buf_init(void) {
   //Kernel functions often return pointers for success and “error pointers” for failures.
   if (IS_ERR(BDev.class)) { 
       //If it failed, you clean up: free the buffer and unregister the device number.
-      kfree(Buffer.Buffer);
+      buf_dev_free(&BDev);
       unregister_chrdev_region(devno, 1);
       // Converts the error pointer to a negative error code (-ENOMEM, -EINVAL, etc.) to return from buf_init().
       printk(KERN_WARNING "buf: (buf_init) error to create buf_class\n");
@@ -215,7 +662,7 @@ int buf_init(void) {
   if (!device_create(BDev.class, NULL, devno, NULL, "buf0")) { //device_create() returns NULL on failure
       // If it fails, we clean up everything we created so far: destroy the class, free the buffer, unregister device number.
       class_destroy(BDev.class);
-      kfree(Buffer.Buffer);
+      buf_dev_free(&BDev);
       unregister_chrdev_region(devno, 1);
       //Return -EINVAL to indicate failure.
       printk(KERN_WARNING "buf: (buf_init) error to create device buf0\n");
@@ -241,7 +688,7 @@ int buf_init(void) {
       /* undo device/class/buffer/major allocation done previously */
       device_destroy(BDev.class, devno); // removes /dev/buf0
       class_destroy(BDev.class);// removes /sys/class/buf_class
-      kfree(Buffer.Buffer); // free kernel buffer memory
+      buf_dev_free(&BDev); // free kernel buffer memory
       unregister_chrdev_region(devno, 1); // release major/minor numbers
       printk(KERN_WARNING "buf: (buf_init) error to add the char driver\n");
       return result; // propagate kernel-style error code up
@@ -261,18 +708,8 @@ void buf_exit(void) {
   device_destroy(BDev.class, devno);
   /* --- Destroy device class --- */
   class_destroy(BDev.class);
-  /* --- Free allocated buffer memory --- */
-  kfree(Buffer.Buffer);
-
-  /* Free ReadBuf and WriteBuf if they were allocated --- */
-  if (BDev.ReadBuf) {
-    kfree(BDev.ReadBuf);
-    BDev.ReadBuf = NULL;  // Good practice
-  }
-  if (BDev.WriteBuf) {
-    kfree(BDev.WriteBuf);
-    BDev.WriteBuf = NULL;  // Good practice
-  }
+  /* --- Free allocated buffer memory (every lane, ReadBuf), auto-sizing timer stopped first --- */
+  buf_dev_free(&BDev);
   /* --- Release major/minor numbers --- */
   unregister_chrdev_region(devno, 1);
   printk(KERN_INFO "buf: module unloaded\n");
@@ -280,79 +717,113 @@ void buf_exit(void) {
 
   
 int buf_open(struct inode *inode, struct file *filp) {
+  return buf_dev_open(&BDev, filp);
+}
+
+/* Ouverture d'un device donné : BDev depuis buf_open(), un device de test depuis KUnit */
+int buf_dev_open(struct Buf_Dev *dev, struct file *filp) {
 
   // 1. Extract the access mode from f_flags
   int mode = filp->f_flags & O_ACCMODE;
-  // 2. Acquire the semaphore to protect shared data (BDev counters)
-  if (down_interruptible(&BDev.SemBuf)){
+  unsigned int lane;
+  // Per-open state (read mode), zeroed = BUF_READ_RAW
+  struct Buf_File *bf = kzalloc(sizeof(*bf), GFP_KERNEL);
+  if (!bf) {
+    printk(KERN_WARNING "buf: (buf_open) failed to allocate per-open state\n");
+    return -ENOMEM;
+  }
+  bf->dev = dev;
+  bf->BusyPoll = -1;
+  INIT_LIST_HEAD(&bf->TapNode);
+  INIT_LIST_HEAD(&bf->BehindNode);
+  INIT_WORK(&bf->Drain, buf_behind_drain);
+  init_waitqueue_head(&bf->FlushQueue);
+  // 2. Acquire the semaphore to protect shared data (device counters)
+  if (down_interruptible(&dev->SemBuf)){
     printk(KERN_WARNING "buf: (buf_open) interrupted while waiting for semaphore\n");
+    kfree(bf);
     return -ERESTARTSYS;
   }
   // 3. Writer access control
   if (mode == O_WRONLY || mode == O_RDWR) {
-    if (BDev.numWriter > 0) {
-      // Only one writer allowed at a time
-      up(&BDev.SemBuf); // release semaphore before returning
+    // One writer per lane: a new writer gets the highest-priority free lane (BUF_IOCSETLANE moves it)
+    for (lane = 0; lane < dev->NumLanes && buf_lane_taken(dev, lane, 0); lane++)
+      ;
+    if (lane == dev->NumLanes) {
+      up(&dev->SemBuf); // release semaphore before returning
+      kfree(bf);
       printk(KERN_WARNING "buf: (buf_open) already opened in writing\n");
       return -EBUSY;    // device busy
     }
-    BDev.numWriter++; // increment writer count
-    // Allocate WriteBuf if not already allocated
-    if (!BDev.WriteBuf) {
-        BDev.WriteBuf = kmalloc(READWRITE_BUFSIZE * sizeof(unsigned short), GFP_KERNEL);
-        if (!BDev.WriteBuf) {
-            up(&BDev.SemBuf);
-            printk(KERN_WARNING "buf: (buf_open) failed to allocate WriteBuf\n");
-            return -ENOMEM;
-        }
-    }
+    bf->Lane = lane;
+    dev->WriterLanes |= 1u << lane;
+    dev->numWriter++; // increment writer count
   }
     // 4. Handle reader access
   if (mode == O_RDONLY || mode == O_RDWR) {
-    BDev.numReader++; // increment reader count
+    dev->numReader++; // increment reader count
     // Allocate ReadBuf if not already allocated
-    if (!BDev.ReadBuf) {
-      BDev.ReadBuf = kmalloc(READWRITE_BUFSIZE * sizeof(unsigned short), GFP_KERNEL);
-      if (!BDev.ReadBuf) {
-        up(&BDev.SemBuf);
+    if (!dev->ReadBuf) {
+      dev->ReadBuf = kmalloc(READWRITE_BUFSIZE * sizeof(unsigned short), GFP_KERNEL);
+      if (!dev->ReadBuf) {
+        up(&dev->SemBuf);
+        kfree(bf);
         printk(KERN_WARNING "buf: (buf_open) failed to allocate ReadBuf\n");
         return -ENOMEM;
       }
     }
   }
-  // 5. Store device pointer in private_data for future use in read/write
-  // file->private_data allows file operations (read/write/ioctl) to access BDev without global lookup.
-  filp->private_data = &BDev;
+  // 5. Store the per-open state (which points to the device) in private_data for future use in read/write
+  // file->private_data allows file operations (read/write/ioctl) to access the device without global lookup.
+  filp->private_data = bf;
   // 6. Release the semaphore
-  up(&BDev.SemBuf);
+  up(&dev->SemBuf);
   printk(KERN_INFO "buf: open\n");
   return 0;
 }
 
 int buf_release(struct inode *inode, struct file *filp) {
   // 1. Retrieve BDev from filp->private_data
-  struct Buf_Dev *dev = filp->private_data;
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
   // 2. Acquire the semaphore to protect shared data
-  // If another process holds it, the current process sleep s.
+  // If another process holds it, the current process sleeps.
   // We use it to prevent race conditions when updating counters.
-  if (down_interruptible(&dev->SemBuf)) {
-    printk(KERN_WARNING "buf: (buf_release) interrupted while waiting for semaphore\n");
-    return -ERESTARTSYS;
-  }
+  // Not interruptible: the per-open state must be unlinked and freed whatever happens.
+  down(&dev->SemBuf);
   // 3. Decrement numWriter and/or numReader depending on f_mode
-  if (filp->f_mode & FMODE_WRITE)
+  if (filp->f_mode & FMODE_WRITE) {
     dev->numWriter--;
+    dev->WriterLanes &= ~(1u << bf->Lane);
+  }
   if (filp->f_mode & FMODE_READ)
     dev->numReader--;
+  // Stop feeding this file's reduced stream
+  list_del(&bf->TapNode);
+  // Write-behind: no new drain can be scheduled once the file is off the list
+  list_del(&bf->BehindNode);
   // 4. Release the semaphore. up() increments the semaphore count and wakes any waiting processes.
   up(&dev->SemBuf);
-  
+  // A drain may still be queued even if write-behind was disabled since: it must not outlive bf
+  cancel_work_sync(&bf->Drain);
+  if (bf->Staged.Buffer) {
+    // Move what still fits; the rest is lost (fsync() first to keep it)
+    down(&dev->SemBuf);
+    buf_behind_move(bf);
+    dev->WbLost += BufNumData(&bf->Staged);
+    up(&dev->SemBuf);
+    kfree(bf->Staged.Buffer);
+  }
+  kfree(bf->Agg.Buffer);
+  kfree(bf);
+
   printk(KERN_INFO "buf: release\n");
   return 0;
 }
 
 ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_pos) {
-  struct Buf_Dev *dev = filp->private_data;
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
   size_t total_bytes_read = 0;           // Total bytes transferred
   size_t requested_bytes_this_iter;            // Bytes to read in current iteration
   int requested_items_this_iter;
@@ -372,6 +843,10 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
     return -EINVAL;  // Invalid size, must be multiple of sizeof(unsigned short)
   }
 
+  // Reduced read modes are served from this file's own record buffer, not from the ring
+  if (bf->Mode.mode != BUF_READ_RAW)
+    return buf_read_reduced(filp, ubuf, count);
+
   // Main loop - continue until all requested data is transferred
   while ( total_bytes_read< count) {
 
@@ -385,7 +860,7 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
     }
       
     // 2.b. Check if buffer is empty
-    if (Buffer.BufEmpty) {
+    if (buf_lanes_empty(dev)) {
       // Release semaphore
       up(&dev->SemBuf);
       // If non-blocking mode, return immediately
@@ -395,10 +870,13 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
           return total_bytes_read;  // Return what we've read so far
         return -EAGAIN;
       }
-      // Blocking mode: sleep until data is available
+      // Blocking mode: spin briefly first, data often arrives sooner than a wakeup would
+      if (buf_busy_poll(bf, -1))
+        continue;
+      // Then sleep until data is available
       // wait_event_interruptible returns 0 if condition became true,
       // or -ERESTARTSYS if interrupted by signal
-      if (wait_event_interruptible(dev->OutQueue, !Buffer.BufEmpty)) {
+      if (wait_event_interruptible(dev->OutQueue, !buf_lanes_empty(dev))) {
         printk(KERN_WARNING "buf: (buf_read) buffer is empty in blocking mode. Waiting was interrupted by a signal\n");
         // Interrupted by signal
         if ( total_bytes_read> 0)
@@ -415,9 +893,9 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
     requested_bytes_this_iter = min(count - total_bytes_read, (size_t)(READWRITE_BUFSIZE * sizeof(unsigned short)));
     requested_items_this_iter = requested_bytes_this_iter / sizeof(unsigned short);
 
-    // Extract data from circular buffer into ReadBuf
+    // Extract data from circular buffer into ReadBuf, highest priority lane first
     for (i = 0; i < requested_items_this_iter; i++) {
-      result = BufOut(&Buffer, &data);
+      result = buf_dequeue(dev, &data);
       if (result < 0) {
         // Buffer became empty (shouldn't happen, but handle it)
         printk(KERN_WARNING "buf : (buf_read) Buffer is empty in extraction data from circular buffer\n"); 
@@ -428,8 +906,15 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
     // Update actual bytes read in this iteration
     items_read_this_iter = i;
     bytes_read_this_iter = items_read_this_iter * sizeof(unsigned short);
+    // Retention mode: f_pos is the sequence number of the next item to read
+    if (dev->Lanes[0].Retain)
+      *f_pos = dev->Lanes[0].InSeq - BufNumData(&dev->Lanes[0]);
     // Wake up any waiting writers (buffer now has space)
     wake_up_interruptible(&dev->InQueue);
+    buf_behind_kick(dev);
+    // Complete parked io_uring enqueues that now fit
+    buf_uring_kick(dev);
+    buf_autosize(dev, -1);
     // Release semaphore
     up(&dev->SemBuf);
 
@@ -462,14 +947,17 @@ ssize_t buf_read(struct file *filp, char __user *ubuf, size_t count, loff_t *f_p
 
 ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff_t *f_pos) {
 
-  struct Buf_Dev *dev = filp->private_data;
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
   size_t total_bytes_written = 0; // total bytes transferred
   size_t requested_bytes_this_iter;
   int requested_items_this_iter;
   unsigned short data;
   int result;
   size_t items_written_this_iter;
-  size_t bytes_written_this_iter;
+  unsigned int lane;
+  unsigned int allowed;
+  u64 wait_ns;
 
   // Check for non-blocking mode
   int nonblocking = filp->f_flags & O_NONBLOCK;
@@ -480,6 +968,10 @@ ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff
     return -EINVAL;
   }
 
+  // Write-behind mode: stage the data and return without waiting for space in the ring
+  if (bf->Staged.Buffer)
+    return buf_write_behind(filp, ubuf, count);
+
   // Main loop: continue until all user data is written
   while (total_bytes_written < count) {
     // Step 1: Copy a chunk from user space into WriteBuf
@@ -487,7 +979,7 @@ ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff
     requested_bytes_this_iter = min(count - total_bytes_written,(size_t)(READWRITE_BUFSIZE * sizeof(unsigned short)));
     requested_items_this_iter = requested_bytes_this_iter / sizeof(unsigned short);
     // Copy
-    if (copy_from_user(dev->WriteBuf, (const void __user *)(ubuf + total_bytes_written), requested_bytes_this_iter)) {
+    if (copy_from_user(bf->WriteBuf, (const void __user *)(ubuf + total_bytes_written), requested_bytes_this_iter)) {
       printk(KERN_WARNING "buf: (buf_write) copy from user space failed\n");
       if (total_bytes_written > 0)
         return total_bytes_written;
@@ -506,8 +998,9 @@ ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff
         return -ERESTARTSYS;
       }
 
-      // 2.b. Check if circular buffer is full
-      if (Buffer.BufFull) {
+      // 2.b. Check if the circular buffer of our lane is full (auto-sizing may grow it instead)
+      lane = buf_writer_lane(bf);
+      if (dev->Lanes[lane].BufFull && !buf_autosize(dev, lane)) {
         // 2.b.1 Release semaphore
         up(&dev->SemBuf);
         // 2.b.2 nonblocking mode: return immediately
@@ -515,39 +1008,51 @@ ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff
           printk(KERN_WARNING "buf: (buf_write) buffer full in non-blocking mode. return immediately\n");
           return total_bytes_written > 0 ? total_bytes_written : -EAGAIN;
         }
-        // 2.b.3 Blocking mode: sleep until buffer has space
-        if (wait_event_interruptible(dev->InQueue, !Buffer.BufFull)) {
+        // 2.b.3 Blocking mode: spin briefly, then sleep until buffer has space
+        if (buf_busy_poll(bf, lane))
+          continue;
+        if (wait_event_interruptible(dev->InQueue, !dev->Lanes[lane].BufFull)) {
           printk(KERN_WARNING "buf: (buf_write) buffer is full in blocking mode. Waiting was interrupted by a signal\n");
           return total_bytes_written > 0 ? total_bytes_written : -ERESTARTSYS;
         }
         continue; // retry acquiring semaphore
       }
 
+      // 2.c. Rate limits: the token buckets may allow only part of the chunk, or nothing yet
+      allowed = buf_rate_allow(bf, requested_items_this_iter - items_written_this_iter, &wait_ns);
+      if (allowed == 0) {
+        // Releases the semaphore; sleeps until the next token unless in nonblocking mode
+        result = buf_rate_throttle(bf, wait_ns, nonblocking);
+        if (result)
+          return total_bytes_written > 0 ? total_bytes_written : result;
+        continue;
+      }
+      allowed += items_written_this_iter;
 
-      // 2.c. Buffer has space: 
-      // 2.c.1 insert data from WriteBuf into circular buffer
-      while (items_written_this_iter < requested_items_this_iter && !Buffer.BufFull) {
-        data = dev->WriteBuf[items_written_this_iter];
-        result = BufIn(&Buffer, &data);
+      // 2.d. Buffer has space: 
+      // 2.d.1 insert data from WriteBuf into circular buffer
+      while (items_written_this_iter < allowed && !dev->Lanes[lane].BufFull) {
+        data = bf->WriteBuf[items_written_this_iter];
+        result = buf_enqueue(dev, lane, &data);
         if (result < 0) {
           // Should not happen, but safety check
           printk(KERN_WARNING "buf: (buf_write) Buffer full during insertion\n");
           break;
         }
+        buf_rate_take(bf, 1);
         items_written_this_iter++;
+        // Count each item as soon as it is in the ring, so an early return reports partial writes
+        total_bytes_written += sizeof(unsigned short);
       }
 
-      // 2.c.2 Wake up any readers waiting
+      // 2.d.2 Wake up any readers waiting, then serve parked io_uring dequeues
       wake_up_interruptible(&dev->OutQueue);
+      buf_uring_kick(dev);
+      buf_autosize(dev, -1);
 
-      // 2.c.3 Release semaphore
+      // 2.d.3 Release semaphore
       up(&dev->SemBuf);
     }
-
-    // Update total bytes transferred
-    bytes_written_this_iter = items_written_this_iter * sizeof(unsigned short);
-    total_bytes_written += bytes_written_this_iter;
-
   }
   
   printk(KERN_INFO "buf: (buf_write) write %zu bytes\n", total_bytes_written);
@@ -555,12 +1060,784 @@ ssize_t buf_write(struct file *filp, const char __user *ubuf, size_t count, loff
 }
 
 
+/* Insère une donnée dans une voie du ring et la transmet aux lecteurs en mode réduit */
+// Every producer path (buf_write(), io_uring ENQUEUE) goes through here, with SemBuf held.
+int buf_enqueue(struct Buf_Dev *dev, unsigned int lane, unsigned short *Data) {
+  struct BufStruct *Buf = &dev->Lanes[lane];
+  struct Buf_File *bf;
+  int ndata;
+
+  if (BufIn(Buf, Data) < 0)
+    return -1;
+  ndata = BufNumData(Buf);
+  if (ndata > Buf->HighWater)
+    Buf->HighWater = ndata;
+  if (ndata > Buf->WinHigh)
+    Buf->WinHigh = ndata;
+  list_for_each_entry(bf, &dev->Taps, TapNode)
+    buf_tap_sample(bf, *Data);
+  return 0;
+}
+
+/* Extrait une donnée de la voie non vide la plus prioritaire */
+int buf_dequeue(struct Buf_Dev *dev, unsigned short *Data) {
+  unsigned int lane;
+
+  for (lane = 0; lane < dev->NumLanes; lane++)
+    if (BufOut(&dev->Lanes[lane], Data) == 0)
+      return 0;
+  return -1;
+}
+
+/* Vrai si toutes les voies actives sont vides */
+int buf_lanes_empty(struct Buf_Dev *dev) {
+  unsigned int lane;
+
+  for (lane = 0; lane < dev->NumLanes; lane++)
+    if (!dev->Lanes[lane].BufEmpty)
+      return 0;
+  return 1;
+}
+
+/* Nombre de données dans l'ensemble des voies */
+int buf_num_data(struct Buf_Dev *dev) {
+  unsigned int lane;
+  int ndata = 0;
+
+  for (lane = 0; lane < dev->NumLanes; lane++)
+    ndata += BufNumData(&dev->Lanes[lane]);
+  return ndata;
+}
+
+/* Vrai si un écrivain, hors des voies choisies except, écrit déjà dans la voie active lane */
+// Writers are tracked by the lane they chose, which may be past the active lanes (see buf_writer_lane()).
+int buf_lane_taken(struct Buf_Dev *dev, unsigned int lane, unsigned int except) {
+  unsigned int l;
+
+  for (l = 0; l < BUF_MAX_LANES; l++)
+    if ((dev->WriterLanes & ~except & (1u << l)) && min(l, dev->NumLanes - 1) == lane)
+      return 1;
+  return 0;
+}
+
+/* Voie utilisée par les écritures d'une ouverture */
+// A lane chosen before BUF_IOCSETLANES reduced the number of lanes falls back to the lowest priority.
+unsigned int buf_writer_lane(struct Buf_File *bf) {
+  return min(bf->Lane, bf->dev->NumLanes - 1);
+}
+
+/* Politique d'auto-dimensionnement des voies (appelée avec SemBuf tenu) */
+// lane >= 0: a writer found this lane full; it is counted and, past grow_blocks events in the window,
+// the lane is doubled now. Returns 1 if it grew (the writer can go on without waiting).
+// lane < 0: only closes the observation window when it has elapsed, which may shrink idle lanes.
+int buf_autosize(struct Buf_Dev *dev, int lane) {
+  struct BufStruct *Buf;
+  unsigned int l, size, cur;
+  unsigned long win, elapsed;
+  u64 total;  // lanes can add up to more than 4 GiB
+  int grown = 0;
+
+  if (lane >= 0)
+    dev->WriterBlocks++;
+  if (!dev->Auto.enable)
+    return 0;
+
+  // 1. Grow a lane whose writers keep blocking, within max_size and the memory budget
+  if (lane >= 0 && !dev->Lanes[lane].Packed && ++dev->Lanes[lane].Blocks >= dev->Auto.grow_blocks) {
+    Buf = &dev->Lanes[lane];
+    size = min(Buf->BufSize * 2, dev->Auto.max_size);
+    if (dev->Auto.budget_bytes) {
+      for (total = 0, l = 0; l < dev->NumLanes; l++)
+        total += dev->Lanes[l].BufSize;
+      total *= sizeof(unsigned short);
+      size = total < dev->Auto.budget_bytes ? min_t(u64, size, Buf->BufSize + (dev->Auto.budget_bytes - total) / sizeof(unsigned short)) : Buf->BufSize;
+    }
+    if (size > Buf->BufSize && BufResize(Buf, size) == 0) {
+      dev->AutoGrows++;
+      dev->AutoLastSize = size;
+      Buf->Blocks = 0;
+      Buf->LowWins = 0;
+      grown = 1;
+      printk(KERN_INFO "buf: (buf_autosize) lane %d grown to %u\n", lane, size);
+    }
+  }
+
+  // 2. End of the observation window(s): shrink lanes that stayed mostly empty
+  if (time_before(jiffies, dev->AutoWinEnd))
+    return grown;
+  // Every window that elapsed since the last call counts: the first saw WinHigh, the others
+  // saw no traffic at all, so only the current occupancy
+  win = max(msecs_to_jiffies(dev->Auto.window_ms), 1UL);
+  elapsed = (jiffies - dev->AutoWinEnd) / win + 1;
+  dev->AutoWinEnd += elapsed * win;
+  for (l = 0; l < dev->NumLanes; l++) {
+    Buf = &dev->Lanes[l];
+    cur = BufNumData(Buf);
+    Buf->Blocks = 0;
+    Buf->LowWins = Buf->WinHigh < Buf->BufSize / 4 ? Buf->LowWins + 1 : 0;
+    if (elapsed > 1)
+      Buf->LowWins = cur < Buf->BufSize / 4 ? Buf->LowWins + min(elapsed - 1, (unsigned long)UINT_MAX / 2) : 0;
+    // The next window starts from the current occupancy
+    Buf->WinHigh = cur;
+    if (Buf->Packed || Buf->LowWins < BUF_AUTO_SHRINK_WINDOWS)
+      continue;
+    // One halving per BUF_AUTO_SHRINK_WINDOWS low windows, while the lane stays mostly empty
+    do {
+      Buf->LowWins -= BUF_AUTO_SHRINK_WINDOWS;
+      size = max_t(unsigned int, Buf->BufSize / 2, dev->Auto.min_size);
+      if (size >= Buf->BufSize || BufResize(Buf, size) != 0) {
+        Buf->LowWins = 0;
+        break;
+      }
+      dev->AutoShrinks++;
+      dev->AutoLastSize = size;
+      printk(KERN_INFO "buf: (buf_autosize) lane %u shrunk to %u\n", l, size);
+    } while (Buf->LowWins >= BUF_AUTO_SHRINK_WINDOWS && cur < Buf->BufSize / 4);
+    if (cur >= Buf->BufSize / 4)
+      Buf->LowWins = 0;
+  }
+  return grown;
+}
+
+/* Ferme les fenêtres d'auto-dimensionnement sans trafic (delayed work, réarmé tant que la politique est active) */
+// Without it, a ring that nobody reads or writes would never be shrunk.
+void buf_autosize_tick(struct work_struct *work) {
+  struct Buf_Dev *dev = container_of(to_delayed_work(work), struct Buf_Dev, AutoWork);
+
+  down(&dev->SemBuf);
+  buf_autosize(dev, -1);
+  if (dev->Auto.enable)
+    schedule_delayed_work(&dev->AutoWork, max(msecs_to_jiffies(dev->Auto.window_ms), 1UL));
+  up(&dev->SemBuf);
+}
+
+/* Attente active bornée avant de s'endormir sur une file d'attente */
+// lane < 0: a reader waits for data in any lane; otherwise a writer waits for space in that lane.
+// The ring is checked without SemBuf, like a wait_event() condition; the caller re-checks it locked.
+// Returns 1 if the condition became true within the budget, 0 if the caller should sleep.
+int buf_busy_poll(struct Buf_File *bf, int lane) {
+  struct Buf_Dev *dev = bf->dev;
+  unsigned int budget = bf->BusyPoll >= 0 ? bf->BusyPoll : READ_ONCE(busy_poll);
+  u64 end;
+
+  if (budget == 0)
+    return 0;
+  end = ktime_get_ns() + min(budget, (unsigned int)BUF_BUSY_POLL_MAX) * NSEC_PER_USEC;
+  do {
+    if (lane < 0 ? !buf_lanes_empty(dev) : !READ_ONCE(dev->Lanes[lane].BufFull)) {
+      atomic_inc(&dev->SpinHits);
+      return 1;
+    }
+    // Never delay a signal or another task on this CPU
+    if (signal_pending(current) || need_resched())
+      break;
+    cpu_relax();
+  } while (ktime_get_ns() < end);
+  atomic_inc(&dev->SpinMisses);
+  return 0;
+}
+
+/* Écriture en mode write-behind : copie dans Staged et retour immédiat */
+// The first items go straight into the ring when nothing is staged (same order, no extra latency);
+// after that they are staged and buf_behind_drain() moves them. Items that fit nowhere are refused.
+ssize_t buf_write_behind(struct file *filp, const char __user *ubuf, size_t count) {
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
+  size_t total_bytes_written = 0;
+  unsigned int lane;
+  int i, n, moved, ret;
+  u64 wait_ns;
+
+  while (total_bytes_written < count) {
+    // 1. Copy a chunk from user space into WriteBuf
+    n = min(count - total_bytes_written, (size_t)(READWRITE_BUFSIZE * sizeof(unsigned short))) / sizeof(unsigned short);
+    if (copy_from_user(bf->WriteBuf, ubuf + total_bytes_written, n * sizeof(unsigned short)))
+      return total_bytes_written > 0 ? total_bytes_written : -EFAULT;
+
+    // 2. Ring first while nothing is staged, then the staging queue
+    if (down_interruptible(&dev->SemBuf))
+      return total_bytes_written > 0 ? total_bytes_written : -ERESTARTSYS;
+    // Rate limits apply when items are accepted, whether they go to the ring or to Staged
+    n = buf_rate_allow(bf, n, &wait_ns);
+    if (n == 0) {
+      ret = buf_rate_throttle(bf, wait_ns, filp->f_flags & O_NONBLOCK);
+      if (ret)
+        return total_bytes_written > 0 ? total_bytes_written : ret;
+      continue;
+    }
+    lane = buf_writer_lane(bf);
+    for (i = 0, moved = 0; i < n; i++) {
+      if (bf->Staged.BufEmpty && buf_enqueue(dev, lane, &bf->WriteBuf[i]) == 0)
+        moved++;
+      else if (BufIn(&bf->Staged, &bf->WriteBuf[i]) < 0)
+        break;
+    }
+    if (moved > 0) {
+      wake_up_interruptible(&dev->OutQueue);
+      buf_uring_kick(dev);
+    }
+    // 3. A full staging queue refuses the rest of the write: the short count reports it, and only
+    // the items of this chunk it turned away count as overflows
+    if (i < n) {
+      bf->Overflows += n - i;
+      dev->WbOverflows += n - i;
+    }
+    buf_rate_take(bf, i);
+    if (!bf->Staged.BufEmpty)
+      schedule_work(&bf->Drain);
+    up(&dev->SemBuf);
+    total_bytes_written += i * sizeof(unsigned short);
+    if (i < n)
+      break;
+  }
+  return total_bytes_written > 0 || count == 0 ? total_bytes_written : -EAGAIN;
+}
+
+/* Déplace les données en attente d'un écrivain write-behind vers sa voie (appelée avec SemBuf tenu) */
+// Returns the number of items moved. Wakes fsync()/BUF_IOCWRFLUSH once the staging queue is empty.
+int buf_behind_move(struct Buf_File *bf) {
+  struct Buf_Dev *dev = bf->dev;
+  unsigned int lane = buf_writer_lane(bf);
+  unsigned short data;
+  int moved = 0;
+
+  while (!bf->Staged.BufEmpty) {
+    // Peek first: an item leaves the staging queue only once it is in the ring
+    // A full ring is not a writer block (the writer already returned): no auto-sizing here
+    if (BufPeek(&bf->Staged, &data, 1) != 1 || buf_enqueue(dev, lane, &data) != 0)
+      break; // ring full: buf_behind_kick() reschedules the drain when readers free space
+    BufOut(&bf->Staged, &data);
+    moved++;
+  }
+  if (moved > 0) {
+    wake_up_interruptible(&dev->OutQueue);
+    buf_uring_kick(dev);
+  }
+  if (bf->Staged.BufEmpty)
+    wake_up_interruptible(&bf->FlushQueue);
+  return moved;
+}
+
+/* Travail du mode write-behind (workqueue système) */
+void buf_behind_drain(struct work_struct *work) {
+  struct Buf_File *bf = container_of(work, struct Buf_File, Drain);
+  struct Buf_Dev *dev = bf->dev;
+
+  down(&dev->SemBuf);
+  dev->WbDrains++;
+  buf_behind_move(bf);
+  up(&dev->SemBuf);
+}
+
+/* Relance le vidage des écrivains write-behind après une libération de place (appelée avec SemBuf tenu) */
+void buf_behind_kick(struct Buf_Dev *dev) {
+  struct Buf_File *bf;
+
+  list_for_each_entry(bf, &dev->Behind, BehindNode)
+    if (!bf->Staged.BufEmpty)
+      schedule_work(&bf->Drain);
+}
+
+/* Barrière : attend que toutes les données en attente soient dans le ring */
+int buf_behind_flush(struct Buf_File *bf, int nonblocking) {
+  struct Buf_Dev *dev = bf->dev;
+  int empty;
+
+  if (!bf->Staged.Buffer)
+    return 0;
+  // Move what fits now rather than waiting for the work item
+  if (down_interruptible(&dev->SemBuf))
+    return -ERESTARTSYS;
+  buf_behind_move(bf);
+  empty = bf->Staged.BufEmpty;
+  up(&dev->SemBuf);
+  if (empty)
+    return 0;
+  if (nonblocking)
+    return -EAGAIN;
+  // The rest goes in as readers free space
+  if (wait_event_interruptible(bf->FlushQueue, READ_ONCE(bf->Staged.BufEmpty)))
+    return -ERESTARTSYS;
+  return 0;
+}
+
+/* Active (size > 0), redimensionne ou désactive (0) le mode write-behind d'une ouverture */
+// The staging queue can only change once everything staged is in the ring. A drain queued earlier
+// then finds an empty queue; buf_release() always cancels it, enabled or not, before freeing bf.
+int buf_behind_set(struct Buf_File *bf, unsigned int size) {
+  struct Buf_Dev *dev = bf->dev;
+  unsigned short *newbuf = NULL;
+
+  if (size > 0 && !(newbuf = kmalloc_array(size, sizeof(unsigned short), GFP_KERNEL)))
+    return -ENOMEM;
+  if (down_interruptible(&dev->SemBuf)) {
+    kfree(newbuf);
+    return -ERESTARTSYS;
+  }
+  if (bf->Staged.Buffer)
+    buf_behind_move(bf);
+  if (bf->Staged.Buffer && !bf->Staged.BufEmpty) {
+    up(&dev->SemBuf);
+    kfree(newbuf);
+    return -EBUSY;
+  }
+  kfree(bf->Staged.Buffer);
+  bf->Staged.Buffer = newbuf;
+  bf->Staged.BufSize = size;
+  BufReset(&bf->Staged);
+  list_del_init(&bf->BehindNode);
+  if (newbuf)
+    list_add_tail(&bf->BehindNode, &dev->Behind);
+  up(&dev->SemBuf);
+  return 0;
+}
+
+/* Exporte le contenu des voies dans une image versionnée (struct buf_image_hdr + données) */
+// The image is built in a kernel buffer under SemBuf with at most two memcpy() per raw lane,
+// then copied to user space in one go. img->len is set to the image size.
+int buf_export(struct Buf_Dev *dev, struct buf_image *img) {
+  struct buf_image_hdr *hdr;
+  struct BufStruct *Buf;
+  unsigned short *data;
+  unsigned int lane, n, start, first;
+  size_t len;
+  int ret = 0;
+
+  if (down_interruptible(&dev->SemBuf))
+    return -ERESTARTSYS;
+  // 1. Image size: header, then retained + unread items of every lane
+  len = sizeof(*hdr);
+  for (lane = 0; lane < dev->NumLanes; lane++)
+    len += (dev->Lanes[lane].Retained + BufNumData(&dev->Lanes[lane])) * sizeof(unsigned short);
+  if (img->len < len) {
+    up(&dev->SemBuf);
+    img->len = len;
+    return -ENOSPC;
+  }
+  hdr = kvzalloc(len, GFP_KERNEL);
+  if (!hdr) {
+    up(&dev->SemBuf);
+    return -ENOMEM;
+  }
+  // 2. Header and data, lane by lane
+  hdr->magic = BUF_IMAGE_MAGIC;
+  hdr->version = BUF_IMAGE_VERSION;
+  hdr->nlanes = dev->NumLanes;
+  hdr->flags = (dev->Lanes[0].Packed ? BUF_IMAGE_PACKED : 0) | (dev->Lanes[0].Retain ? BUF_IMAGE_RETAIN : 0);
+  data = (unsigned short *)(hdr + 1);
+  for (lane = 0; lane < dev->NumLanes; lane++) {
+    Buf = &dev->Lanes[lane];
+    hdr->lane[lane].size = Buf->BufSize;
+    hdr->lane[lane].numdata = BufNumData(Buf);
+    hdr->lane[lane].retained = Buf->Retained;
+    hdr->lane[lane].highwater = Buf->HighWater;
+    hdr->lane[lane].inseq = Buf->InSeq;
+    n = Buf->Retained + hdr->lane[lane].numdata;
+    if (Buf->Packed) {
+      // Blocks are decoded in order; there is no retained history in packed mode
+      BufPeek(Buf, data, n);
+    } else if (n > 0) {
+      // The oldest item may sit before the end of the array: copy up to the end, then the start
+      start = (Buf->OutIdx + Buf->BufSize - Buf->Retained) % Buf->BufSize;
+      first = min(n, Buf->BufSize - start);
+      memcpy(data, &Buf->Buffer[start], first * sizeof(unsigned short));
+      memcpy(data + first, Buf->Buffer, (n - first) * sizeof(unsigned short));
+    }
+    data += n;
+  }
+  up(&dev->SemBuf);
+
+  // 3. One copy to the caller's buffer (a memfd mapping works too)
+  if (copy_to_user(u64_to_user_ptr(img->addr), hdr, len))
+    ret = -EFAULT;
+  kvfree(hdr);
+  img->len = len;
+  return ret;
+}
+
+/* Restaure une image produite par buf_export() dans un device vide */
+// Raw lanes are filled by one copy_from_user() each, straight into their new array; packed lanes
+// re-encode their items. Like BUF_IOCSETLANES, the device is only changed once everything is ready.
+int buf_import(struct Buf_Dev *dev, struct buf_image *img) {
+  struct buf_image_hdr hdr;
+  struct buf_image_lane *il;
+  struct BufStruct *lanes, *Buf;
+  unsigned short *packed = NULL;
+  const char __user *src = u64_to_user_ptr(img->addr);
+  unsigned int lane, n, i;
+  size_t total = 0, len = sizeof(hdr);
+  int ret = 0;
+
+  // 1. Header checks
+  if (img->len < sizeof(hdr))
+    return -EINVAL;
+  if (copy_from_user(&hdr, src, sizeof(hdr)))
+    return -EFAULT;
+  if (hdr.magic != BUF_IMAGE_MAGIC || hdr.version != BUF_IMAGE_VERSION)
+    return -EINVAL;
+  if (hdr.nlanes < 1 || hdr.nlanes > BUF_MAX_LANES || (hdr.flags & ~(BUF_IMAGE_PACKED | BUF_IMAGE_RETAIN)))
+    return -EINVAL;
+  // Same rules as BUF_IOCSETPACKED / BUF_IOCSETRETAIN
+  if ((hdr.flags & BUF_IMAGE_RETAIN) && (hdr.nlanes > 1 || (hdr.flags & BUF_IMAGE_PACKED)))
+    return -EINVAL;
+  for (lane = 0; lane < hdr.nlanes; lane++) {
+    il = &hdr.lane[lane];
+    // A packed lane holds more items than its size, but never more than a pool of header-only
+    // blocks (all deltas zero) plus a full stage; whether the data really fits is known once re-encoded
+    if ((hdr.flags & BUF_IMAGE_PACKED) ?
+        (il->size < BUF_PACK_MINSIZE || il->retained ||
+         il->numdata > (u64)il->size * sizeof(unsigned short) / BUF_PACK_HDRSIZE * BUF_PACK_BLOCK + BUF_PACK_BLOCK) :
+        (il->size < 1 || il->numdata > il->size || il->retained > il->size - il->numdata))
+      return -EINVAL;
+    // Sizes are added as size_t; up to 8 lanes of 32-bit counts must not wrap
+    if (check_add_overflow(total, (size_t)il->numdata, &total) ||
+        check_add_overflow(len, ((size_t)il->retained + il->numdata) * sizeof(unsigned short), &len))
+      return -EINVAL;
+  }
+  if (img->len < len)
+    return -EINVAL;
+
+  // 2. Build the new lanes outside SemBuf, packed ones re-encoded: nothing is installed unless all of them fit
+  lanes = kcalloc(BUF_MAX_LANES, sizeof(*lanes), GFP_KERNEL);
+  if (!lanes)
+    return -ENOMEM;
+  if ((hdr.flags & BUF_IMAGE_PACKED) && !(packed = kvmalloc_array(max_t(size_t, total, 1), sizeof(unsigned short), GFP_KERNEL))) {
+    kfree(lanes);
+    return -ENOMEM;
+  }
+  src += sizeof(hdr);
+  for (lane = 0; lane < BUF_MAX_LANES; lane++) {
+    Buf = &lanes[lane];
+    il = &hdr.lane[lane];
+    Buf->Packed = (hdr.flags & BUF_IMAGE_PACKED) != 0;
+    Buf->Retain = (hdr.flags & BUF_IMAGE_RETAIN) != 0;
+    BufReset(Buf);
+    if (lane >= hdr.nlanes || ret)
+      continue;
+    Buf->BufSize = il->size;
+    n = il->retained + il->numdata;
+    if (!(Buf->Buffer = kmalloc_array(il->size, sizeof(unsigned short), GFP_KERNEL)))
+      ret = -ENOMEM;
+    else if (copy_from_user(packed ? packed : Buf->Buffer, src, n * sizeof(unsigned short)))
+      ret = -EFAULT;
+    src += n * sizeof(unsigned short);
+    if (ret)
+      continue;
+    if (Buf->Packed) {
+      // Blocks may be cut differently from the exporter's: the pool must still hold them
+      for (i = 0; i < il->numdata && !ret; i++)
+        if (BufIn(Buf, &packed[i]) < 0)
+          ret = -ENOSPC;
+    } else {
+      // Items already sit at the start of the array, oldest first
+      Buf->Retained = il->retained;
+      Buf->OutIdx = il->retained % il->size;
+      Buf->InIdx = n % il->size;
+      Buf->BufEmpty = (il->numdata == 0);
+      Buf->BufFull = (il->numdata == il->size);
+    }
+    Buf->InSeq = il->inseq;
+    Buf->HighWater = max(il->highwater, (__u32)BufNumData(Buf));
+  }
+  kvfree(packed);
+  if (!ret && down_interruptible(&dev->SemBuf))
+    ret = -ERESTARTSYS;
+  // Never overwrite data that is still unread
+  else if (!ret && !buf_lanes_empty(dev)) {
+    up(&dev->SemBuf);
+    ret = -EBUSY;
+  }
+  if (ret) {
+    for (lane = 0; lane < BUF_MAX_LANES; lane++)
+      kfree(lanes[lane].Buffer);
+    kfree(lanes);
+    return ret;
+  }
+
+  // 3. Install the lanes
+  for (lane = 0; lane < BUF_MAX_LANES; lane++) {
+    kfree(dev->Lanes[lane].Buffer);
+    dev->Lanes[lane] = lanes[lane];
+  }
+  dev->NumLanes = hdr.nlanes;
+  wake_up_interruptible(&dev->OutQueue);
+  wake_up_interruptible(&dev->InQueue);
+  buf_uring_kick(dev);
+  up(&dev->SemBuf);
+  kfree(lanes);
+  printk(KERN_INFO "buf: (buf_import) %u lane(s), %zu item(s) restored\n", hdr.nlanes, total);
+  return 0;
+}
+
+/* (Re)configure un seau à jetons ; il démarre plein (appelée avec SemBuf tenu) */
+void buf_bucket_set(struct BufBucket *b, unsigned int rate, unsigned int burst) {
+  b->Rate = rate;
+  b->Burst = rate ? burst : 0;
+  b->Tokens = (s64)b->Burst * NSEC_PER_SEC;
+  b->Last = ktime_get_ns();
+}
+
+/* Ajoute les jetons accumulés depuis le dernier remplissage, sans dépasser Burst */
+void buf_bucket_refill(struct BufBucket *b, u64 now) {
+  s64 cap = (s64)b->Burst * NSEC_PER_SEC;
+  u64 delta = now - b->Last;
+
+  if (b->Rate == 0)
+    return;
+  b->Last = now;
+  // Compare before multiplying: a long idle period would overflow delta * Rate
+  if (delta >= div_u64(cap - b->Tokens, b->Rate))
+    b->Tokens = cap;
+  else
+    b->Tokens += delta * b->Rate;
+}
+
+/* Nombre de données que le seau laisse passer maintenant */
+unsigned int buf_bucket_avail(struct BufBucket *b) {
+  if (b->Rate == 0)
+    return UINT_MAX;
+  return b->Tokens > 0 ? div_u64(b->Tokens, NSEC_PER_SEC) : 0;
+}
+
+/* Temps (ns) avant que le seau contienne need données (plafonné à Burst), 0 = tout de suite */
+u64 buf_bucket_wait(struct BufBucket *b, unsigned int need) {
+  s64 want;
+
+  if (b->Rate == 0)
+    return 0;
+  want = (s64)min(need, b->Burst) * NSEC_PER_SEC;
+  if (b->Tokens >= want)
+    return 0;
+  return div_u64(want - b->Tokens + b->Rate - 1, b->Rate);
+}
+
+/* Données qu'un écrivain peut insérer maintenant selon les seaux du device et de l'ouverture */
+// Called with SemBuf held. When nothing is allowed, *wait_ns is the time until the next token.
+unsigned int buf_rate_allow(struct Buf_File *bf, unsigned int want, u64 *wait_ns) {
+  struct Buf_Dev *dev = bf->dev;
+  u64 now = ktime_get_ns();
+  unsigned int n;
+
+  buf_bucket_refill(&dev->Rate, now);
+  buf_bucket_refill(&bf->Rate, now);
+  n = min3(want, buf_bucket_avail(&dev->Rate), buf_bucket_avail(&bf->Rate));
+  if (n == 0)
+    *wait_ns = max(buf_bucket_wait(&dev->Rate, 1), buf_bucket_wait(&bf->Rate, 1));
+  return n;
+}
+
+/* Temps (ns) avant qu'un lot io_uring de n données puisse passer en entier, 0 = tout de suite */
+// A batch is never split: it waits for min(n, Burst) tokens in each bucket, then takes n.
+u64 buf_rate_batch(struct Buf_File *bf, unsigned int n) {
+  struct Buf_Dev *dev = bf->dev;
+  u64 now = ktime_get_ns();
+
+  buf_bucket_refill(&dev->Rate, now);
+  buf_bucket_refill(&bf->Rate, now);
+  return max(buf_bucket_wait(&dev->Rate, n), buf_bucket_wait(&bf->Rate, n));
+}
+
+/* Consomme les jetons de n données insérées, ou les rend si n < 0 (appelée avec SemBuf tenu) */
+void buf_rate_take(struct Buf_File *bf, int n) {
+  if (bf->dev->Rate.Rate)
+    bf->dev->Rate.Tokens -= (s64)n * NSEC_PER_SEC;
+  if (bf->Rate.Rate)
+    bf->Rate.Tokens -= (s64)n * NSEC_PER_SEC;
+}
+
+/* Écrivain à court de jetons : refus en mode non bloquant, sinon sommeil jusqu'au prochain jeton */
+// Called with SemBuf held; always releases it. Returns 0 when the caller should retry.
+int buf_rate_throttle(struct Buf_File *bf, u64 wait_ns, int nonblocking) {
+  struct Buf_Dev *dev = bf->dev;
+  ktime_t timeout = ns_to_ktime(wait_ns);
+
+  if (nonblocking) {
+    bf->Refused++;
+    dev->RlRefused++;
+    up(&dev->SemBuf);
+    return -EAGAIN;
+  }
+  bf->Throttled++;
+  dev->RlThrottled++;
+  dev->RlWaitNs += wait_ns;
+  up(&dev->SemBuf);
+  // High-resolution sleep: a jiffy would be far longer than one token at high rates
+  set_current_state(TASK_INTERRUPTIBLE);
+  schedule_hrtimeout_range(&timeout, wait_ns >> 3, HRTIMER_MODE_REL);
+  return signal_pending(current) ? -ERESTARTSYS : 0;
+}
+
+/* fsync() : barrière du mode write-behind */
+int buf_fsync(struct file *filp, loff_t start, loff_t end, int datasync) {
+  return buf_behind_flush(filp->private_data, 0);
+}
+
+/* Accumule une donnée dans la fenêtre d'un lecteur en mode réduit et produit ses enregistrements */
+void buf_tap_sample(struct Buf_File *bf, unsigned short Data) {
+  unsigned short rec[4];
+  int i, n;
+
+  if (bf->Mode.mode == BUF_READ_THRESHOLD) {
+    // Only the values beyond the threshold are kept
+    if (Data <= bf->Mode.threshold)
+      return;
+    rec[0] = Data;
+    n = 1;
+  } else {
+    // Window accumulation for BUF_READ_DECIMATE and BUF_READ_MINMAXMEAN
+    if (bf->WinCount == 0) {
+      bf->WinFirst = bf->WinMin = bf->WinMax = Data;
+      bf->WinSum = 0;
+    }
+    bf->WinMin = min(bf->WinMin, Data);
+    bf->WinMax = max(bf->WinMax, Data);
+    bf->WinSum += Data;
+    if (++bf->WinCount < bf->Mode.window)
+      return;
+    if (bf->Mode.mode == BUF_READ_DECIMATE) {
+      rec[0] = bf->WinFirst;
+      n = 1;
+    } else {
+      rec[0] = bf->WinMin;
+      rec[1] = bf->WinMax;
+      rec[2] = bf->WinSum / bf->WinCount;
+      rec[3] = bf->WinCount;
+      n = 4;
+    }
+    bf->WinCount = 0;
+  }
+
+  // A slow reduced reader loses whole records, never stalls the writer
+  if (bf->Agg.BufSize - BufNumData(&bf->Agg) < n) {
+    bf->Mode.dropped++;
+    return;
+  }
+  for (i = 0; i < n; i++)
+    BufIn(&bf->Agg, &rec[i]);
+}
+
+/* Change le mode de lecture d'une ouverture (appelée avec SemBuf tenu) */
+int buf_set_readmode(struct Buf_File *bf, struct buf_readmode *mode) {
+  struct Buf_Dev *dev = bf->dev;
+
+  switch (mode->mode) {
+    case BUF_READ_RAW:
+    case BUF_READ_THRESHOLD:
+      break;
+    case BUF_READ_DECIMATE:
+      if (mode->window == 0)
+        return -EINVAL;
+      break;
+    case BUF_READ_MINMAXMEAN:
+      // The record carries the window's count in an unsigned short
+      if (mode->window == 0 || mode->window > USHRT_MAX)
+        return -EINVAL;
+      break;
+    default:
+      return -EINVAL;
+  }
+  // The record buffer is allocated on the first switch to a reduced mode
+  if (mode->mode != BUF_READ_RAW && !bf->Agg.Buffer) {
+    bf->Agg.Buffer = kmalloc(BUF_AGG_BUFSIZE * sizeof(unsigned short), GFP_KERNEL);
+    if (!bf->Agg.Buffer)
+      return -ENOMEM;
+    bf->Agg.BufSize = BUF_AGG_BUFSIZE;
+  }
+
+  // Start from an empty window and record buffer
+  bf->Mode.mode = mode->mode;
+  bf->Mode.window = mode->window;
+  bf->Mode.threshold = mode->threshold;
+  bf->Mode.dropped = 0;
+  bf->WinCount = 0;
+  BufReset(&bf->Agg);
+
+  list_del_init(&bf->TapNode);
+  if (mode->mode != BUF_READ_RAW)
+    list_add_tail(&bf->TapNode, &dev->Taps);
+  return 0;
+}
+
+/* buf_read() pour les modes réduits : copie les enregistrements produits par buf_tap_sample() */
+// The ring itself is left untouched, so the full-rate consumers see every sample as before.
+ssize_t buf_read_reduced(struct file *filp, char __user *ubuf, size_t count) {
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
+  unsigned short recs[READWRITE_BUFSIZE];
+  size_t recsize, total_bytes_read = 0;
+  int i, items;
+
+  // Records are never split: min/max/mean records are 4 items, the others 1 item
+  recsize = (bf->Mode.mode == BUF_READ_MINMAXMEAN ? 4 : 1) * sizeof(unsigned short);
+  if (count < recsize)
+    return -EINVAL;
+  count -= count % recsize;
+
+  while (total_bytes_read < count) {
+    if (down_interruptible(&dev->SemBuf))
+      return total_bytes_read > 0 ? total_bytes_read : -ERESTARTSYS;
+
+    // No record yet: same blocking rules as the raw stream
+    if (bf->Agg.BufEmpty) {
+      up(&dev->SemBuf);
+      if (total_bytes_read > 0)
+        break;
+      if (filp->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+      if (wait_event_interruptible(dev->OutQueue, !bf->Agg.BufEmpty))
+        return -ERESTARTSYS;
+      continue;
+    }
+
+    // READWRITE_BUFSIZE is a multiple of the record size, so whole records are copied
+    items = min(count - total_bytes_read, sizeof(recs)) / sizeof(unsigned short);
+    for (i = 0; i < items && BufOut(&bf->Agg, &recs[i]) == 0; i++)
+      ;
+    up(&dev->SemBuf);
+
+    if (copy_to_user(ubuf + total_bytes_read, recs, i * sizeof(unsigned short)))
+      return total_bytes_read > 0 ? total_bytes_read : -EFAULT;
+    total_bytes_read += i * sizeof(unsigned short);
+    if (i < items)
+      break;
+  }
+  return total_bytes_read;
+}
+
+/* Redimensionne la voie d'écriture de bf à size éléments (BUF_IOCSETBUFSIZE) */
+int buf_set_bufsize(struct Buf_File *bf, int size) {
+  struct Buf_Dev *dev = bf->dev;
+  int retval;
+
+  // ACQUIRE SEMAPHORE
+  if (down_trylock(&dev->SemBuf))
+    return -EAGAIN;
+  // Validate the new size, then copy the data of this file's lane into a buffer of size items
+  retval = size > 0 ? BufResize(&dev->Lanes[buf_writer_lane(bf)], size) : -EINVAL;
+  if (retval) {
+    // Release semaphore
+    up(&dev->SemBuf);
+    return retval;
+  }
+  // A larger ring may let parked io_uring enqueues proceed
+  wake_up_interruptible(&dev->InQueue);
+  buf_behind_kick(dev);
+  buf_uring_kick(dev);
+
+  // RELEASE SEMAPHORE
+  up(&dev->SemBuf);
+  return 0;
+}
+
+
 //arg : an argument passed from user space (usually a pointer to data).
 long buf_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
-  struct Buf_Dev *dev = filp->private_data;
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
   int err = 0;
   int retval = 0;
   int tmp;
+  unsigned int lane;
 
   /* check magic number and command */
   if (_IOC_TYPE(cmd) != BUF_IOC_MAGIC) //should match your device magic number
@@ -587,13 +1864,8 @@ long buf_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
         printk(KERN_WARNING "buf: (buf_ioctl) could not lock semaphore for BUF_IOCGETNUMDATA\n");
         return -EAGAIN; // non-blocking
       }
-      // Calculate number of data items in the buffer
-      // If the buffer is full, the number of items equals the buffer size.
-      if (Buffer.BufFull)
-        tmp = Buffer.BufSize;
-      // If not full, it calculates the difference between InIdx and OutIdx, adjusted for wrap-around using modulo.
-      else
-        tmp = (Buffer.InIdx - Buffer.OutIdx + Buffer.BufSize) % Buffer.BufSize;
+      // Calculate number of data items in the buffer (all lanes)
+      tmp = buf_num_data(dev);
       // Releases the semaphore.
       up(&dev->SemBuf);
       //arg is just a number (an address in user-space memory).
@@ -613,7 +1885,8 @@ long buf_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
       break;
 
     case BUF_IOCGETBUFSIZE:
-      tmp = Buffer.BufSize;
+      // Capacity of the caller's lane, the one BUF_IOCSETBUFSIZE resizes (the single ring by default)
+      tmp = dev->Lanes[buf_writer_lane(bf)].BufSize;
       if (copy_to_user((int __user *)arg, &tmp, sizeof(int)))
         return -EFAULT;
       break;
@@ -622,64 +1895,714 @@ long buf_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
       // Only allow if user has modify capabilities (is admin)
       if (!capable(CAP_SYS_RESOURCE))
         return -EPERM;  // only admin
-      // ACQUIRE SEMAPHORE
-      if (down_trylock(&dev->SemBuf)) 
-        return -EAGAIN;
       // Get new buffer size from user
       // copy the integer value from user space (pointed to by arg) into tmp.
-      if (get_user(tmp, (int __user *)arg)) {
-        // if not successful, release semaphore and return -EFAULT
+      if (get_user(tmp, (int __user *)arg))
+        return -EFAULT;
+      retval = buf_set_bufsize(bf, tmp);
+      if (retval)
+        return retval;
+      break;
+
+    case BUF_IOCGETSTATS: {
+      struct buf_stats stats = {0};
+      struct Buf_File *bfi;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      stats.numdata = buf_num_data(dev);
+      stats.packed = dev->Lanes[0].Packed;
+      for (lane = 0; lane < dev->NumLanes; lane++) {
+        stats.bufsize += dev->Lanes[lane].BufSize;
+        stats.raw_bytes += dev->Lanes[lane].RawBytes;
+        stats.packed_bytes += dev->Lanes[lane].PackedBytes;
+      }
+      stats.writer_blocks = dev->WriterBlocks;
+      stats.auto_grows = dev->AutoGrows;
+      stats.auto_shrinks = dev->AutoShrinks;
+      stats.auto_lastsize = dev->AutoLastSize;
+      stats.spin_hits = atomic_read(&dev->SpinHits);
+      stats.spin_misses = atomic_read(&dev->SpinMisses);
+      list_for_each_entry(bfi, &dev->Behind, BehindNode)
+        stats.wb_pending += BufNumData(&bfi->Staged);
+      stats.wb_overflows = dev->WbOverflows;
+      stats.wb_lost = dev->WbLost;
+      stats.wb_drains = dev->WbDrains;
+      stats.rl_throttled = dev->RlThrottled;
+      stats.rl_refused = dev->RlRefused;
+      stats.rl_wait_ns = dev->RlWaitNs;
+      up(&dev->SemBuf);
+      // Achieved ratio of the blocks packed so far, x100 (100 = no gain)
+      stats.comp_ratio_x100 = stats.packed_bytes ? div64_u64(stats.raw_bytes * 100, stats.packed_bytes) : 100;
+      if (copy_to_user((struct buf_stats __user *)arg, &stats, sizeof(stats)))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCSETPACKED:
+      // Switching the storage format is a device-wide change, like resizing
+      if (!capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (get_user(tmp, (int __user *)arg))
+        return -EFAULT;
+      if (down_trylock(&dev->SemBuf))
+        return -EAGAIN;
+      // The format of the stored data cannot change under it, and a block must fit in every lane's pool
+      if (!buf_lanes_empty(dev)) {
         up(&dev->SemBuf);
+        return -EBUSY;
+      }
+      for (lane = 0; lane < dev->NumLanes; lane++) {
+        if (tmp && (dev->Lanes[lane].BufSize < BUF_PACK_MINSIZE || dev->Lanes[lane].Retain)) {
+          up(&dev->SemBuf);
+          return -EINVAL;
+        }
+      }
+      for (lane = 0; lane < dev->NumLanes; lane++) {
+        dev->Lanes[lane].Packed = (tmp != 0);
+        BufReset(&dev->Lanes[lane]);
+        dev->Lanes[lane].RawBytes = 0;
+        dev->Lanes[lane].PackedBytes = 0;
+      }
+      up(&dev->SemBuf);
+      break;
+
+    case BUF_IOCSETLANES: {
+      struct buf_lanes lanes;
+      unsigned short *newbufs[BUF_MAX_LANES] = { NULL };
+
+      // Re-partitioning the ring is a device-wide change, like resizing
+      if (!capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (copy_from_user(&lanes, (struct buf_lanes __user *)arg, sizeof(lanes)))
         return -EFAULT;
+      // Retention (sequence numbers) needs a single lane
+      if (lanes.nlanes < 1 || lanes.nlanes > BUF_MAX_LANES || (lanes.nlanes > 1 && dev->Lanes[0].Retain))
+        return -EINVAL;
+      // Allocate every lane before touching the device, so a failure leaves it unchanged
+      for (lane = 0; lane < lanes.nlanes; lane++) {
+        if (lanes.size[lane] < (dev->Lanes[0].Packed ? BUF_PACK_MINSIZE : 1))
+          retval = -EINVAL;
+        else if (!(newbufs[lane] = kmalloc_array(lanes.size[lane], sizeof(unsigned short), GFP_KERNEL)))
+          retval = -ENOMEM;
+        if (retval)
+          break;
       }
-      // Validate new size
-      //If the new size (tmp) is smaller than the number of items already in the buffer, we cannot shrink.
-      // if buffer is full, we have BufSize items
-      // else we have (InIdx - OutIdx + BufSize) % BufSize items
-      // (Buffer.BufFull ? Buffer.BufSize : (Buffer.InIdx - Buffer.OutIdx + Buffer.BufSize) % Buffer.BufSize)
-      if (tmp < (Buffer.BufFull ? Buffer.BufSize : (Buffer.InIdx - Buffer.OutIdx + Buffer.BufSize) % Buffer.BufSize)) {
-        // Release semaphore
+      if (!retval && down_trylock(&dev->SemBuf))
+        retval = -EAGAIN;
+      // Data cannot be moved between lanes, so they must all be empty; fewer lanes must not
+      // leave two open writers on the same lane
+      else if (!retval && (!buf_lanes_empty(dev) || hweight32(dev->WriterLanes >> (lanes.nlanes - 1)) > 1)) {
         up(&dev->SemBuf);
-        return -EINVAL; // cannot shrink below current data
+        retval = -EBUSY;
+      }
+      if (retval) {
+        for (lane = 0; lane < BUF_MAX_LANES; lane++)
+          kfree(newbufs[lane]);
+        return retval;
       }
+      for (lane = 0; lane < BUF_MAX_LANES; lane++) {
+        kfree(dev->Lanes[lane].Buffer);
+        dev->Lanes[lane].Buffer = newbufs[lane];
+        dev->Lanes[lane].BufSize = lane < lanes.nlanes ? lanes.size[lane] : 0;
+        dev->Lanes[lane].Packed = dev->Lanes[0].Packed;
+        dev->Lanes[lane].Retain = dev->Lanes[0].Retain;
+        BufReset(&dev->Lanes[lane]);
+      }
+      dev->NumLanes = lanes.nlanes;
+      // Blocked writers re-check the lane they write to
+      wake_up_interruptible(&dev->InQueue);
+      buf_behind_kick(dev);
+      up(&dev->SemBuf);
+      printk(KERN_INFO "buf: (buf_ioctl) %u priority lane(s)\n", dev->NumLanes);
+      break;
+    }
+
+    case BUF_IOCGETLANES: {
+      struct buf_lanes lanes = { 0 };
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      lanes.nlanes = dev->NumLanes;
+      for (lane = 0; lane < dev->NumLanes; lane++) {
+        lanes.size[lane] = dev->Lanes[lane].BufSize;
+        lanes.numdata[lane] = BufNumData(&dev->Lanes[lane]);
+        lanes.highwater[lane] = dev->Lanes[lane].HighWater;
+      }
+      up(&dev->SemBuf);
+      if (copy_to_user((struct buf_lanes __user *)arg, &lanes, sizeof(lanes)))
+        return -EFAULT;
+      break;
+    }
 
-      //Allocates a new buffer in kernel memory of size tmp (the new requested buffer size) multiplied by sizeof(unsigned short)
-      unsigned short *newbuf = kmalloc(tmp * sizeof(unsigned short), GFP_KERNEL);
-      // Check if allocation succeeded
-      if (!newbuf) {
-        // Allocation failed, release semaphore and return
+    case BUF_IOCSETLANE:
+      // Lane used by the following writes of this open file (0 = highest priority)
+      if (!(filp->f_mode & FMODE_WRITE))
+        return -EBADF;
+      if (get_user(tmp, (int __user *)arg))
+        return -EFAULT;
+      if (tmp < 0 || tmp >= BUF_MAX_LANES)
+        return -EINVAL;
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      // One writer per lane
+      if (buf_lane_taken(dev, min_t(unsigned int, tmp, dev->NumLanes - 1), 1u << bf->Lane)) {
         up(&dev->SemBuf);
-        return -ENOMEM;
+        return -EBUSY;
+      }
+      dev->WriterLanes = (dev->WriterLanes & ~(1u << bf->Lane)) | (1u << tmp);
+      bf->Lane = tmp;
+      up(&dev->SemBuf);
+      break;
+
+    case BUF_IOCSETRETAIN:
+      // Keeping history changes what writers may overwrite: device-wide, like resizing
+      if (!capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (get_user(tmp, (int __user *)arg))
+        return -EFAULT;
+      if (down_trylock(&dev->SemBuf))
+        return -EAGAIN;
+      // Sequence numbers are only meaningful for a single raw ring
+      if (tmp && (dev->NumLanes > 1 || dev->Lanes[0].Packed)) {
+        up(&dev->SemBuf);
+        return -EINVAL;
+      }
+      dev->Lanes[0].Retain = (tmp != 0);
+      dev->Lanes[0].Retained = 0;
+      up(&dev->SemBuf);
+      break;
+
+    case BUF_IOCGETSEQ: {
+      struct buf_seq seq;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      seq.newest = dev->Lanes[0].InSeq;
+      seq.next = seq.newest - BufNumData(&dev->Lanes[0]);
+      seq.oldest = seq.next - dev->Lanes[0].Retained;
+      up(&dev->SemBuf);
+      if (copy_to_user((struct buf_seq __user *)arg, &seq, sizeof(seq)))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCSETREADMODE: {
+      struct buf_readmode mode;
+
+      if (!(filp->f_mode & FMODE_READ))
+        return -EBADF;
+      if (copy_from_user(&mode, (struct buf_readmode __user *)arg, sizeof(mode)))
+        return -EFAULT;
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      retval = buf_set_readmode(bf, &mode);
+      up(&dev->SemBuf);
+      break;
+    }
+
+    case BUF_IOCGETREADMODE: {
+      struct buf_readmode mode;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      mode = bf->Mode;
+      up(&dev->SemBuf);
+      if (copy_to_user((struct buf_readmode __user *)arg, &mode, sizeof(mode)))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCSETBUSYPOLL:
+      // Per-open, like SO_BUSY_POLL: -1 falls back to the busy_poll module parameter
+      if (get_user(tmp, (int __user *)arg))
+        return -EFAULT;
+      if (tmp < -1 || tmp > BUF_BUSY_POLL_MAX)
+        return -EINVAL;
+      bf->BusyPoll = tmp;
+      break;
+
+    case BUF_IOCGETBUSYPOLL:
+      tmp = bf->BusyPoll >= 0 ? bf->BusyPoll : min(READ_ONCE(busy_poll), (unsigned int)BUF_BUSY_POLL_MAX);
+      if (copy_to_user((int __user *)arg, &tmp, sizeof(int)))
+        return -EFAULT;
+      break;
+
+    case BUF_IOCSETWRBEHIND: {
+      struct buf_wrbehind wb;
+
+      if (!(filp->f_mode & FMODE_WRITE))
+        return -EBADF;
+      if (copy_from_user(&wb, (struct buf_wrbehind __user *)arg, sizeof(wb)))
+        return -EFAULT;
+      if (wb.size > BUF_WRBEHIND_MAX)
+        return -EINVAL;
+      retval = buf_behind_set(bf, wb.size);
+      break;
+    }
+
+    case BUF_IOCGETWRBEHIND: {
+      struct buf_wrbehind wb;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      wb.size = bf->Staged.Buffer ? bf->Staged.BufSize : 0;
+      wb.pending = bf->Staged.Buffer ? BufNumData(&bf->Staged) : 0;
+      wb.overflows = bf->Overflows;
+      up(&dev->SemBuf);
+      if (copy_to_user((struct buf_wrbehind __user *)arg, &wb, sizeof(wb)))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCWRFLUSH:
+      retval = buf_behind_flush(bf, filp->f_flags & O_NONBLOCK);
+      break;
+
+    case BUF_IOCEXPORT: {
+      struct buf_image img;
+
+      if (copy_from_user(&img, (struct buf_image __user *)arg, sizeof(img)))
+        return -EFAULT;
+      retval = buf_export(dev, &img);
+      // The image size is reported also when the buffer was too small
+      if ((retval == 0 || retval == -ENOSPC) && put_user(img.len, &((struct buf_image __user *)arg)->len))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCIMPORT: {
+      struct buf_image img;
+
+      // Replacing the whole ring is a device-wide change, like resizing
+      if (!capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (copy_from_user(&img, (struct buf_image __user *)arg, sizeof(img)))
+        return -EFAULT;
+      retval = buf_import(dev, &img);
+      break;
+    }
+
+    case BUF_IOCSETAUTOSIZE: {
+      struct buf_autosize policy;
+
+      // The policy resizes the ring on its own: device-wide, like resizing
+      if (!capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (copy_from_user(&policy, (struct buf_autosize __user *)arg, sizeof(policy)))
+        return -EFAULT;
+      if (policy.enable && (policy.min_size == 0 || policy.max_size < policy.min_size ||
+                            policy.window_ms == 0 || policy.grow_blocks == 0))
+        return -EINVAL;
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      dev->Auto = policy;
+      // Start a fresh observation window
+      dev->AutoWinEnd = jiffies + msecs_to_jiffies(policy.window_ms);
+      for (lane = 0; lane < dev->NumLanes; lane++) {
+        dev->Lanes[lane].WinHigh = BufNumData(&dev->Lanes[lane]);
+        dev->Lanes[lane].Blocks = 0;
+        dev->Lanes[lane].LowWins = 0;
       }
+      up(&dev->SemBuf);
+      // Close windows on an idle device too; the tick stops re-arming once the policy is off
+      if (policy.enable)
+        mod_delayed_work(system_wq, &dev->AutoWork, max(msecs_to_jiffies(policy.window_ms), 1UL));
+      else
+        cancel_delayed_work_sync(&dev->AutoWork);
+      break;
+    }
+
+    case BUF_IOCGETAUTOSIZE: {
+      struct buf_autosize policy;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      policy = dev->Auto;
+      up(&dev->SemBuf);
+      if (copy_to_user((struct buf_autosize __user *)arg, &policy, sizeof(policy)))
+        return -EFAULT;
+      break;
+    }
+
+    case BUF_IOCSETRATE:
+    case BUF_IOCSETDEVRATE: {
+      struct buf_ratelimit rl;
 
-      // CALCULATE how many data items are currently in the buffer
-      int ndata = Buffer.BufFull ? Buffer.BufSize : (Buffer.InIdx - Buffer.OutIdx + Buffer.BufSize) % Buffer.BufSize;
-      // Copy existing data to new buffer
-      for (int i = 0; i < ndata; i++){
-        newbuf[i] = Buffer.Buffer[(Buffer.OutIdx + i) % Buffer.BufSize];
+      // The device-wide limit outlives the writer's open file: admin only, like resizing
+      if (cmd == BUF_IOCSETDEVRATE && !capable(CAP_SYS_RESOURCE))
+        return -EPERM;
+      if (cmd == BUF_IOCSETRATE && !(filp->f_mode & FMODE_WRITE))
+        return -EBADF;
+      if (copy_from_user(&rl, (struct buf_ratelimit __user *)arg, sizeof(rl)))
+        return -EFAULT;
+      if (rl.rate && rl.burst == 0)
+        return -EINVAL;
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      buf_bucket_set(cmd == BUF_IOCSETDEVRATE ? &dev->Rate : &bf->Rate, rl.rate, rl.burst);
+      up(&dev->SemBuf);
+      break;
+    }
+
+    case BUF_IOCGETRATE:
+    case BUF_IOCGETDEVRATE: {
+      struct buf_ratelimit rl;
+
+      if (down_interruptible(&dev->SemBuf))
+        return -ERESTARTSYS;
+      if (cmd == BUF_IOCGETDEVRATE) {
+        rl.rate = dev->Rate.Rate;
+        rl.burst = dev->Rate.Burst;
+        rl.throttled = dev->RlThrottled;
+        rl.refused = dev->RlRefused;
+      } else {
+        rl.rate = bf->Rate.Rate;
+        rl.burst = bf->Rate.Burst;
+        rl.throttled = bf->Throttled;
+        rl.refused = bf->Refused;
       }
-      // Update Buffer structure to use new buffer
-      // Free old buffer memory
-      kfree(Buffer.Buffer);
-      // Update Buffer to point to new buffer
-      Buffer.Buffer = newbuf;
-      // buffer size is now updated to tmp
-      Buffer.BufSize = tmp;
-      // indices are reset: InIdx points to the end of the copied data,
-      Buffer.InIdx = ndata;
-      // OutIdx is reset to 0
-      Buffer.OutIdx = 0;
-      // Update full/empty flags
-      Buffer.BufFull = (ndata == Buffer.BufSize);
-      Buffer.BufEmpty = (ndata == 0);
-
-      // RELEASE SEMAPHORE
       up(&dev->SemBuf);
+      if (copy_to_user((struct buf_ratelimit __user *)arg, &rl, sizeof(rl)))
+        return -EFAULT;
       break;
+    }
 
     default:
         return -ENOTTY;
   }
 
   return retval;
-}
\ No newline at end of file
+}
+
+/* Repositionne la lecture dans l'historique conservé (mode rétention) */
+// Positions are item sequence numbers, not bytes:
+//   SEEK_SET  : absolute sequence number (a checkpoint)
+//   SEEK_CUR  : relative to the next item to read
+//   SEEK_END  : relative to the next item to be written (0 = only new data)
+//   SEEK_DATA : first retained item at or after off (0 = oldest)
+// The position is shared by all readers: rewinding makes read items unread again.
+loff_t buf_llseek(struct file *filp, loff_t off, int whence) {
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned long long next, oldest;
+  long long target;
+  unsigned int ndata;
+
+  if (!Buf->Retain)
+    return -ESPIPE;
+  if (down_interruptible(&dev->SemBuf))
+    return -ERESTARTSYS;
+
+  // 1. Current window of sequence numbers: [oldest, newest) with next = first unread
+  ndata = BufNumData(Buf);
+  next = Buf->InSeq - ndata;
+  oldest = next - Buf->Retained;
+  switch (whence) {
+    case SEEK_SET: target = off; break;
+    case SEEK_CUR: target = next + off; break;
+    case SEEK_END: target = Buf->InSeq + off; break;
+    case SEEK_DATA: target = max_t(long long, off, oldest); break;
+    default:
+      up(&dev->SemBuf);
+      return -EINVAL;
+  }
+  // Overwritten or not yet written
+  if (target < (long long)oldest || target > (long long)Buf->InSeq) {
+    up(&dev->SemBuf);
+    return -ENXIO;
+  }
+
+  // 2. Move OutIdx; items between the old and new position switch between retained and unread
+  if (target < (long long)next) {
+    Buf->OutIdx = (Buf->OutIdx + Buf->BufSize - (next - target)) % Buf->BufSize;
+    Buf->Retained -= next - target;
+    ndata += next - target;
+    wake_up_interruptible(&dev->OutQueue);
+  } else {
+    Buf->OutIdx = (Buf->OutIdx + (target - next)) % Buf->BufSize;
+    Buf->Retained += target - next;
+    ndata -= target - next;
+    wake_up_interruptible(&dev->InQueue);
+    buf_behind_kick(dev);
+  }
+  Buf->BufFull = (ndata == Buf->BufSize);
+  Buf->BufEmpty = (ndata == 0);
+  buf_uring_kick(dev);
+  up(&dev->SemBuf);
+
+  filp->f_pos = target;
+  return target;
+}
+
+
+/* --- io_uring passthrough (IORING_OP_URING_CMD) --- */
+
+// The driver state of a parked command lives in the 32-byte pdu area of struct io_uring_cmd.
+struct BufUringPdu *buf_uring_pdu(struct io_uring_cmd *ioucmd) {
+  BUILD_BUG_ON(sizeof(struct BufUringPdu) > sizeof(ioucmd->pdu));
+  return (struct BufUringPdu *)ioucmd->pdu;
+}
+
+// Acquire SemBuf from the io_uring issue path.
+// Without IO_URING_F_NONBLOCK we may sleep; otherwise -EAGAIN makes io_uring retry from a worker.
+int buf_uring_lock(struct Buf_Dev *dev, unsigned int issue_flags) {
+  if (issue_flags & IO_URING_F_NONBLOCK)
+    return down_trylock(&dev->SemBuf) ? -EAGAIN : 0;
+  return down_interruptible(&dev->SemBuf) ? -EINTR : 0;
+}
+
+// Task-work callback of a DEQUEUE completed by buf_uring_kick(): runs in the submitter's context,
+// so the items taken from the ring can be copied to its user buffer here.
+void buf_uring_rd_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+  struct BufUringReq *req = buf_uring_pdu(ioucmd)->Req;
+  ssize_t ret = req->Done;
+
+  if (copy_to_user(req->UserAddr, req->Items, req->Done * sizeof(unsigned short))) {
+    printk(KERN_WARNING "buf: (buf_uring_rd_done) copy to user space failed\n");
+    ret = -EFAULT;
+  }
+  kfree(req);
+  io_uring_cmd_done(ioucmd, ret, 0, issue_flags);
+}
+
+// Task-work callback of an ENQUEUE completed by buf_uring_kick(): the items are already in the ring.
+void buf_uring_wr_done(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+  struct BufUringReq *req = buf_uring_pdu(ioucmd)->Req;
+  ssize_t ret = req->Done;
+
+  kfree(req);
+  io_uring_cmd_done(ioucmd, ret, 0, issue_flags);
+}
+
+/* Fait progresser les commandes io_uring en attente (appelée avec SemBuf tenu) */
+// Called from the wake path of buf_read(), buf_write() and BUF_IOCSETBUFSIZE.
+// Parked commands are served in FIFO order, and every command that became complete is posted
+// through io_uring task work, so one call completes a whole batch of CQEs.
+void buf_uring_kick(struct Buf_Dev *dev) {
+  struct BufUringPdu *pdu, *next;
+  struct BufUringReq *req;
+  unsigned short data;
+  int progress;
+
+  do {
+    progress = 0;
+
+    // 1. Pending dequeues: complete each one with whatever is available (like read()).
+    list_for_each_entry_safe(pdu, next, &dev->UringRd, node) {
+      if (buf_lanes_empty(dev))
+        break;
+      req = pdu->Req;
+      while (req->Done < req->NumItems && buf_dequeue(dev, &data) == 0)
+        req->Items[req->Done++] = data;
+      list_del_init(&pdu->node);
+      io_uring_cmd_complete_in_task(container_of((void *)pdu, struct io_uring_cmd, pdu), buf_uring_rd_done);
+      wake_up_interruptible(&dev->InQueue);
+      buf_behind_kick(dev);
+      progress = 1;
+    }
+
+    // 2. Pending enqueues: complete only once the whole batch is in the ring (like a blocking write()).
+    list_for_each_entry_safe(pdu, next, &dev->UringWr, node) {
+      req = pdu->Req;
+      if (dev->Lanes[req->Lane].BufFull)
+        break;
+      while (req->Done < req->NumItems && buf_enqueue(dev, req->Lane, &req->Items[req->Done]) == 0) {
+        req->Done++;
+        progress = 1;
+      }
+      wake_up_interruptible(&dev->OutQueue);
+      if (req->Done < req->NumItems)
+        break; // ring full again, keep FIFO order
+      list_del_init(&pdu->node);
+      io_uring_cmd_complete_in_task(container_of((void *)pdu, struct io_uring_cmd, pdu), buf_uring_wr_done);
+    }
+    // Data enqueued in step 2 may satisfy dequeues parked in step 1, and vice versa.
+  } while (progress && !list_empty(&dev->UringRd) && !buf_lanes_empty(dev));
+}
+
+// Entry point of IORING_OP_URING_CMD on /dev/buf0.
+// sqe->cmd_op holds one of the BUF_IOCURING_* commands and the sqe->cmd area holds a struct buf_uring_cmd.
+// Returns the result of the CQE, or -EIOCBQUEUED when the command is parked until buf_uring_kick().
+int buf_uring_cmd(struct io_uring_cmd *ioucmd, unsigned int issue_flags) {
+  struct file *filp = ioucmd->file;
+  struct Buf_File *bf = filp->private_data;
+  struct Buf_Dev *dev = bf->dev;
+  struct BufUringPdu *pdu = buf_uring_pdu(ioucmd);
+  const struct buf_uring_cmd *cmd = io_uring_sqe_cmd(ioucmd->sqe);
+  int nonblocking = filp->f_flags & O_NONBLOCK;
+  struct BufUringReq *req;
+  void __user *uaddr;
+  unsigned int nitems;
+  unsigned short data;
+  unsigned int lane;
+  u64 wait_ns;
+  int ret;
+
+  // 1. Cancellation of a parked command (ring teardown or IORING_OP_ASYNC_CANCEL)
+  if (issue_flags & IO_URING_F_CANCEL) {
+    down(&dev->SemBuf);
+    // An empty node means buf_uring_kick() already queued its completion.
+    if (list_empty(&pdu->node)) {
+      up(&dev->SemBuf);
+      return 0;
+    }
+    list_del_init(&pdu->node);
+    // The batch took its tokens as a whole: give back those of the items that never got in
+    if (ioucmd->cmd_op == BUF_IOCURING_ENQUEUE)
+      buf_rate_take(bf, (int)pdu->Req->Done - (int)pdu->Req->NumItems);
+    up(&dev->SemBuf);
+    // A partially enqueued batch reports what actually went into the ring
+    ret = pdu->Req->Done > 0 ? pdu->Req->Done : -ECANCELED;
+    kfree(pdu->Req);
+    io_uring_cmd_done(ioucmd, ret, 0, issue_flags);
+    return 0;
+  }
+
+  // 2. Decode the batch descriptor (the sqe is only guaranteed stable during issue)
+  uaddr = u64_to_user_ptr(READ_ONCE(cmd->addr));
+  nitems = READ_ONCE(cmd->nitems);
+  if (READ_ONCE(cmd->flags))
+    return -EINVAL;
+  INIT_LIST_HEAD(&pdu->node);
+
+  switch (ioucmd->cmd_op) {
+    case BUF_IOCURING_STATUS:
+      // Number of data items in the buffer, like BUF_IOCGETNUMDATA
+      ret = buf_uring_lock(dev, issue_flags);
+      if (ret)
+        return ret;
+      ret = buf_num_data(dev);
+      up(&dev->SemBuf);
+      return ret;
+
+    case BUF_IOCURING_PEEK:
+    case BUF_IOCURING_DEQUEUE:
+      if (!(filp->f_mode & FMODE_READ))
+        return -EBADF;
+      break;
+
+    case BUF_IOCURING_ENQUEUE:
+      if (!(filp->f_mode & FMODE_WRITE))
+        return -EBADF;
+      // Would overtake the staged items
+      if (bf->Staged.Buffer)
+        return -EINVAL;
+      break;
+
+    default:
+      return -ENOTTY;
+  }
+
+  if (nitems == 0 || nitems > BUF_URING_MAXITEMS)
+    return -EINVAL;
+  req = kmalloc(struct_size(req, Items, nitems), GFP_KERNEL);
+  if (!req)
+    return -ENOMEM;
+  req->UserAddr = uaddr;
+  req->NumItems = nitems;
+  req->Done = 0;
+  // The writer side copies its batch in now, while the submitter's memory is mapped.
+  if (ioucmd->cmd_op == BUF_IOCURING_ENQUEUE &&
+      copy_from_user(req->Items, uaddr, nitems * sizeof(unsigned short))) {
+    kfree(req);
+    return -EFAULT;
+  }
+
+  // 3. Acquire the semaphore
+  ret = buf_uring_lock(dev, issue_flags);
+  if (ret) {
+    kfree(req);
+    return ret;
+  }
+
+  // 4. Try to complete inline; parked commands go first to keep FIFO order.
+  switch (ioucmd->cmd_op) {
+    case BUF_IOCURING_PEEK:
+      // Copy the next items a reader would get, without consuming them
+      for (ret = 0, lane = 0; lane < dev->NumLanes; lane++)
+        ret += BufPeek(&dev->Lanes[lane], &req->Items[ret], nitems - ret);
+      up(&dev->SemBuf);
+      if (copy_to_user(uaddr, req->Items, ret * sizeof(unsigned short)))
+        ret = -EFAULT;
+      kfree(req);
+      return ret;
+
+    case BUF_IOCURING_DEQUEUE:
+      if (list_empty(&dev->UringRd) && !buf_lanes_empty(dev)) {
+        while (req->Done < nitems && buf_dequeue(dev, &data) == 0)
+          req->Items[req->Done++] = data;
+        wake_up_interruptible(&dev->InQueue);
+        buf_behind_kick(dev);
+        buf_uring_kick(dev);
+        up(&dev->SemBuf);
+        ret = req->Done;
+        if (copy_to_user(uaddr, req->Items, req->Done * sizeof(unsigned short)))
+          ret = -EFAULT;
+        kfree(req);
+        return ret;
+      }
+      break;
+
+    case BUF_IOCURING_ENQUEUE:
+      // Rate limits: the batch waits for its tokens as a whole. Only the io-wq worker may sleep or
+      // refuse (O_NONBLOCK), so the inline issue returns -EAGAIN and io_uring retries from a worker:
+      // a refusal is counted once, when the command completes.
+      while ((wait_ns = buf_rate_batch(bf, nitems)) != 0) {
+        if (issue_flags & IO_URING_F_NONBLOCK) {
+          up(&dev->SemBuf);
+          kfree(req);
+          return -EAGAIN;
+        }
+        ret = buf_rate_throttle(bf, wait_ns, nonblocking);
+        if (ret == 0)
+          ret = buf_uring_lock(dev, issue_flags);
+        if (ret) {
+          kfree(req);
+          return ret == -ERESTARTSYS ? -EINTR : ret;
+        }
+      }
+      buf_rate_take(bf, nitems);
+      req->Lane = buf_writer_lane(bf);
+      if (list_empty(&dev->UringWr)) {
+        // A full lane counts as a writer block event and may be grown by the auto-sizing policy
+        while (req->Done < nitems) {
+          if (buf_enqueue(dev, req->Lane, &req->Items[req->Done]) == 0)
+            req->Done++;
+          else if (!buf_autosize(dev, req->Lane))
+            break;
+        }
+        if (req->Done > 0) {
+          wake_up_interruptible(&dev->OutQueue);
+          buf_uring_kick(dev);
+        }
+        if (req->Done == nitems) {
+          up(&dev->SemBuf);
+          kfree(req);
+          return nitems;
+        }
+      }
+      break;
+  }
+
+  // 5. Not satisfiable now: fail like read()/write() in non-blocking mode, or park the command.
+  if (nonblocking) {
+    // Items that did not get in will be submitted again: give their tokens back
+    if (ioucmd->cmd_op == BUF_IOCURING_ENQUEUE)
+      buf_rate_take(bf, (int)req->Done - (int)nitems);
+    up(&dev->SemBuf);
+    ret = req->Done > 0 ? req->Done : -EAGAIN;
+    kfree(req);
+    return ret;
+  }
+  pdu->Req = req;
+  list_add_tail(&pdu->node, ioucmd->cmd_op == BUF_IOCURING_DEQUEUE ? &dev->UringRd : &dev->UringWr);
+  io_uring_cmd_mark_cancelable(ioucmd, issue_flags);
+  up(&dev->SemBuf);
+  return -EIOCBQUEUED;
+}
+
+#if IS_ENABLED(CONFIG_BUF_DRIVER_KUNIT_TEST)
+#include "buf_driver_test.c"
+#endif
@@ -0,0 +1,816 @@
+/*
+ * Tests KUnit du pilote ring buffer.
+ * Inclus à la fin de buf_driver.c (CONFIG_BUF_DRIVER_KUNIT_TEST) pour accéder aux fonctions internes.
+ * Chaque test travaille sur son propre device, jamais sur BDev : le pilote chargé n'est pas touché.
+ */
+#include <kunit/test.h>
+#include <linux/mman.h>  // PROT_*, MAP_* : mémoire utilisateur de kunit_vm_mmap()
+
+#define BUF_TEST_UMEM (4 * PAGE_SIZE) /* mémoire utilisateur d'un test */
+
+/* Libère un device de test (action KUnit) */
+static void buf_test_dev_free(void *dev) {
+  buf_dev_free(dev);
+}
+
+/* Crée un device de test, libéré automatiquement à la fin du test */
+static struct Buf_Dev *buf_test_dev(struct kunit *test) {
+  struct Buf_Dev *dev = kunit_kzalloc(test, sizeof(*dev), GFP_KERNEL);
+
+  KUNIT_ASSERT_NOT_NULL(test, dev);
+  KUNIT_ASSERT_EQ(test, buf_dev_setup(dev), 0);
+  KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, buf_test_dev_free, dev), 0);
+  return dev;
+}
+
+/* Ferme une ouverture de test (action KUnit) */
+static void buf_test_release(void *filp) {
+  buf_release(NULL, filp);
+}
+
+/* Ouvre un device de test ; fermé avant la libération du device (actions en ordre inverse) */
+static struct file *buf_test_open(struct kunit *test, struct Buf_Dev *dev, unsigned int flags) {
+  struct file *filp = kunit_kzalloc(test, sizeof(*filp), GFP_KERNEL);
+  int mode = flags & O_ACCMODE;
+
+  KUNIT_ASSERT_NOT_NULL(test, filp);
+  filp->f_flags = flags;
+  if (mode == O_RDONLY || mode == O_RDWR)
+    filp->f_mode |= FMODE_READ;
+  if (mode == O_WRONLY || mode == O_RDWR)
+    filp->f_mode |= FMODE_WRITE;
+  KUNIT_ASSERT_EQ(test, buf_dev_open(dev, filp), 0);
+  KUNIT_ASSERT_EQ(test, kunit_add_action_or_reset(test, buf_test_release, filp), 0);
+  return filp;
+}
+
+/* Mémoire utilisateur pour buf_read()/buf_write() et les images */
+static char __user *buf_test_umem(struct kunit *test) {
+  unsigned long addr = kunit_vm_mmap(test, NULL, 0, BUF_TEST_UMEM, PROT_READ | PROT_WRITE,
+                                     MAP_ANONYMOUS | MAP_PRIVATE, 0);
+
+  KUNIT_ASSERT_NE_MSG(test, addr, 0, "could not create user memory");
+  KUNIT_ASSERT_FALSE(test, IS_ERR_VALUE(addr));
+  return (char __user *)addr;
+}
+
+/* Donnée n d'une suite pseudo-aléatoire (largeur de delta maximale en mode compressé) */
+static unsigned short buf_test_noise(unsigned int n) {
+  return (n * 2654435761u) >> 16;
+}
+
+/* Donnée n d'une suite lente (deltas de quelques bits en mode compressé) */
+static unsigned short buf_test_smooth(unsigned int n) {
+  return 1000 + n / 2 + (n & 3);
+}
+
+/* buf_ioctl() avec *arg copié dans la mémoire utilisateur umem, puis relu */
+static long buf_test_ioctl(struct kunit *test, struct file *filp, unsigned int cmd, char __user *umem, void *arg) {
+  long ret;
+
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, arg, _IOC_SIZE(cmd)), 0);
+  ret = buf_ioctl(filp, cmd, (unsigned long)umem);
+  KUNIT_ASSERT_EQ(test, copy_from_user(arg, umem, _IOC_SIZE(cmd)), 0);
+  return ret;
+}
+
+/* write() de n données first, first + 1, ... ; retourne le nombre de données acceptées ou l'erreur */
+static int buf_test_write(struct kunit *test, struct file *filp, char __user *umem, unsigned short first, int n) {
+  ssize_t ret;
+  int i;
+
+  for (i = 0; i < n; i++)
+    KUNIT_ASSERT_EQ(test, put_user((unsigned short)(first + i), (unsigned short __user *)umem + i), 0);
+  ret = buf_write(filp, umem, n * sizeof(unsigned short), &filp->f_pos);
+  return ret < 0 ? ret : ret / sizeof(unsigned short);
+}
+
+/* read() d'au plus n données dans data ; retourne le nombre de données lues ou l'erreur */
+static int buf_test_read(struct kunit *test, struct file *filp, char __user *umem, unsigned short *data, int n) {
+  ssize_t ret = buf_read(filp, umem, n * sizeof(unsigned short), &filp->f_pos);
+
+  if (ret > 0)
+    KUNIT_ASSERT_EQ(test, copy_from_user(data, umem, ret), 0);
+  return ret < 0 ? ret : ret / sizeof(unsigned short);
+}
+
+
+/* --- Ring brut : BufIn() / BufOut() / BufResize() --- */
+
+static void buf_test_wrap(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned short v, in = 0, out = 0;
+  int i;
+
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 8), 0);
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_EQ(test, BufOut(Buf, &v), -1);
+
+  // 5 in, 3 out, then 6 in: InIdx wraps past the end and meets OutIdx
+  for (i = 0; i < 5; i++, in++)
+    KUNIT_ASSERT_EQ(test, BufIn(Buf, &in), 0);
+  for (i = 0; i < 3; i++, out++) {
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+    KUNIT_EXPECT_EQ(test, v, out);
+  }
+  for (i = 0; i < 6; i++, in++)
+    KUNIT_ASSERT_EQ(test, BufIn(Buf, &in), 0);
+  KUNIT_EXPECT_TRUE(test, Buf->BufFull);
+  KUNIT_EXPECT_FALSE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 8);
+  KUNIT_EXPECT_EQ(test, BufIn(Buf, &in), -1);
+
+  // Everything comes back in order
+  for (i = 0; i < 8; i++, out++) {
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+    KUNIT_EXPECT_EQ(test, v, out);
+  }
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_FALSE(test, Buf->BufFull);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 0);
+}
+
+static void buf_test_resize(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned short v, in = 0, out = 0;
+  int i;
+
+  // Wrapped content: 6 items starting at index 5 of 8
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 8), 0);
+  for (i = 0; i < 5; i++, in++, out++) {
+    KUNIT_ASSERT_EQ(test, BufIn(Buf, &in), 0);
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+  }
+  for (i = 0; i < 6; i++, in++)
+    KUNIT_ASSERT_EQ(test, BufIn(Buf, &in), 0);
+  KUNIT_ASSERT_LT(test, Buf->InIdx, Buf->OutIdx);
+
+  // Grow: data unwrapped, oldest first
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 16), 0);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 16u);
+  KUNIT_EXPECT_EQ(test, Buf->OutIdx, 0u);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 6);
+  KUNIT_EXPECT_FALSE(test, Buf->BufFull);
+
+  // Shrink to exactly the number of items: full; below it or to 0: refused, nothing changed
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 6), 0);
+  KUNIT_EXPECT_TRUE(test, Buf->BufFull);
+  KUNIT_EXPECT_EQ(test, BufResize(Buf, 5), -EINVAL);
+  KUNIT_EXPECT_EQ(test, BufResize(Buf, 0), -EINVAL);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 6u);
+
+  for (i = 0; i < 6; i++, out++) {
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+    KUNIT_EXPECT_EQ(test, v, out);
+  }
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+}
+
+static void buf_test_set_bufsize(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *filp = buf_test_open(test, dev, O_WRONLY);
+  struct Buf_File *bf = filp->private_data;
+
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, 32), 0);
+  KUNIT_EXPECT_EQ(test, dev->Lanes[0].BufSize, 32u);
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, 0), -EINVAL);
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, -1), -EINVAL);
+
+  // Never waits for SemBuf
+  down(&dev->SemBuf);
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, 64), -EAGAIN);
+  up(&dev->SemBuf);
+  KUNIT_EXPECT_EQ(test, dev->Lanes[0].BufSize, 32u);
+
+  // A packed lane can only be resized while empty
+  dev->Lanes[0].Packed = 1;
+  BufReset(&dev->Lanes[0]);
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, BUF_PACK_MINSIZE - 1), -EINVAL);
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, BUF_PACK_MINSIZE), 0);
+  BufIn(&dev->Lanes[0], &(unsigned short){ 1 });
+  KUNIT_EXPECT_EQ(test, buf_set_bufsize(bf, 128), -EBUSY);
+}
+
+
+/* --- Stockage compressé --- */
+
+/* Remplit une voie compressée de la suite gen jusqu'à ce qu'elle soit pleine, puis la relit */
+static void buf_test_pack_fill(struct kunit *test, struct BufStruct *Buf, unsigned short (*gen)(unsigned int)) {
+  unsigned short v, peek[BUF_PACK_BLOCK];
+  unsigned int n = 0, i, count;
+
+  while (BufIn(Buf, &(unsigned short){ gen(n) }) == 0)
+    n++;
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), (int)n);
+  KUNIT_EXPECT_TRUE(test, Buf->BufFull);
+
+  count = BufPeek(Buf, peek, BUF_PACK_BLOCK);
+  for (i = 0; i < count; i++)
+    KUNIT_EXPECT_EQ(test, peek[i], gen(i));
+  for (i = 0; i < n; i++) {
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+    KUNIT_ASSERT_EQ_MSG(test, v, gen(i), "item %u of %u", i, n);
+  }
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_EQ(test, Buf->PoolUsed, 0u);
+}
+
+static void buf_test_packed(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned int in = 0, out = 0, round, i;
+  unsigned short v;
+
+  Buf->Packed = 1;
+  BufReset(Buf);
+
+  // Slow signal: several items per pool slot; noise: no gain, but still exact
+  buf_test_pack_fill(test, Buf, buf_test_smooth);
+  KUNIT_EXPECT_GT(test, Buf->RawBytes, 2ull * Buf->PackedBytes);
+  buf_test_pack_fill(test, Buf, buf_test_noise);
+
+  // Interleaved writes and reads move the blocks around the pool, across its end
+  for (round = 0; round < 50; round++) {
+    for (i = 0; i < 97; i++, in++)
+      if (BufIn(Buf, &(unsigned short){ buf_test_noise(in) }) < 0)
+        break;
+    for (i = 0; i < 61 && out < in; i++, out++) {
+      KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+      KUNIT_ASSERT_EQ(test, v, buf_test_noise(out));
+    }
+  }
+  while (out < in) {
+    KUNIT_ASSERT_EQ(test, BufOut(Buf, &v), 0);
+    KUNIT_ASSERT_EQ(test, v, buf_test_noise(out++));
+  }
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 0);
+}
+
+
+/* --- Rétention et llseek --- */
+
+static void buf_test_retain_llseek(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *filp = buf_test_open(test, dev, O_RDWR);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned short v, in = 0;
+  int i;
+
+  // Without retention there is nothing to seek in
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, SEEK_SET), (loff_t)-ESPIPE);
+
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 8), 0);
+  Buf->Retain = 1;
+  for (i = 0; i < 6; i++, in++)
+    KUNIT_ASSERT_EQ(test, buf_enqueue(dev, 0, &in), 0);
+  for (i = 0; i < 4; i++)
+    KUNIT_ASSERT_EQ(test, buf_dequeue(dev, &v), 0);
+  KUNIT_EXPECT_EQ(test, Buf->Retained, 4u);
+
+  // Sequence numbers: 0..3 already read, 4..5 unread
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, SEEK_CUR), (loff_t)4);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 1, SEEK_SET), (loff_t)1);
+  KUNIT_EXPECT_EQ(test, filp->f_pos, (loff_t)1);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 5);
+  KUNIT_ASSERT_EQ(test, buf_dequeue(dev, &v), 0);
+  KUNIT_EXPECT_EQ(test, v, 1);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, SEEK_END), (loff_t)6);
+  KUNIT_EXPECT_TRUE(test, Buf->BufEmpty);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, SEEK_DATA), (loff_t)0);
+  KUNIT_EXPECT_EQ(test, BufNumData(Buf), 6);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, 42), (loff_t)-EINVAL);
+
+  // Fill, read 3, then 3 new items overwrite the 3 oldest kept ones
+  for (i = 0; i < 2; i++, in++)
+    KUNIT_ASSERT_EQ(test, buf_enqueue(dev, 0, &in), 0);
+  KUNIT_EXPECT_TRUE(test, Buf->BufFull);
+  KUNIT_EXPECT_EQ(test, buf_enqueue(dev, 0, &in), -1);
+  for (i = 0; i < 3; i++)
+    KUNIT_ASSERT_EQ(test, buf_dequeue(dev, &v), 0);
+  for (i = 0; i < 3; i++, in++)
+    KUNIT_ASSERT_EQ(test, buf_enqueue(dev, 0, &in), 0);
+  KUNIT_EXPECT_EQ(test, Buf->Retained, 0u);
+  KUNIT_EXPECT_EQ(test, Buf->InSeq, 11ull);
+
+  // Overwritten or not yet written
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 2, SEEK_SET), (loff_t)-ENXIO);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 12, SEEK_SET), (loff_t)-ENXIO);
+  KUNIT_EXPECT_EQ(test, buf_llseek(filp, 0, SEEK_DATA), (loff_t)3);
+  KUNIT_ASSERT_EQ(test, buf_dequeue(dev, &v), 0);
+  KUNIT_EXPECT_EQ(test, v, 3);
+}
+
+
+/* --- read() / write() --- */
+
+static void buf_test_rw(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *wr = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  struct file *rd = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  char __user *umem = buf_test_umem(test);
+  unsigned short data[40];
+  int i;
+
+  // A second writer is refused
+  KUNIT_EXPECT_EQ(test, buf_dev_open(dev, &(struct file){ .f_flags = O_WRONLY }), -EBUSY);
+
+  KUNIT_ASSERT_EQ(test, BufResize(&dev->Lanes[0], 16), 0);
+  for (i = 0; i < 40; i++)
+    data[i] = 100 + i;
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, data, sizeof(data)), 0);
+
+  // Partial write: only what fits, then -EAGAIN; odd sizes are refused
+  KUNIT_EXPECT_EQ(test, buf_write(wr, umem, sizeof(data), &wr->f_pos), (ssize_t)(16 * sizeof(unsigned short)));
+  KUNIT_EXPECT_EQ(test, buf_write(wr, umem, sizeof(data), &wr->f_pos), (ssize_t)-EAGAIN);
+  KUNIT_EXPECT_EQ(test, buf_write(wr, umem, 3, &wr->f_pos), (ssize_t)-EINVAL);
+  KUNIT_EXPECT_EQ(test, buf_read(rd, umem, 3, &rd->f_pos), (ssize_t)-EINVAL);
+
+  // Partial read into another part of the user buffer, then -EAGAIN
+  memset(data, 0, sizeof(data));
+  KUNIT_EXPECT_EQ(test, buf_read(rd, umem + PAGE_SIZE, 20 * sizeof(unsigned short), &rd->f_pos),
+                  (ssize_t)(16 * sizeof(unsigned short)));
+  KUNIT_EXPECT_EQ(test, buf_read(rd, umem + PAGE_SIZE, 2, &rd->f_pos), (ssize_t)-EAGAIN);
+  KUNIT_ASSERT_EQ(test, copy_from_user(data, umem + PAGE_SIZE, 16 * sizeof(unsigned short)), 0);
+  for (i = 0; i < 16; i++)
+    KUNIT_EXPECT_EQ(test, data[i], 100 + i);
+
+  // A bad user pointer fails cleanly
+  KUNIT_EXPECT_EQ(test, buf_write(wr, NULL, 2, &wr->f_pos), (ssize_t)-EFAULT);
+  KUNIT_EXPECT_TRUE(test, buf_lanes_empty(dev));
+}
+
+
+/* --- Voies de priorité --- */
+
+static void buf_test_lanes(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *wr = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  struct file *rd = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  char __user *umem = buf_test_umem(test);
+  struct buf_lanes lanes = { .nlanes = 3, .size = { 4, 8, 16 } };
+  static const unsigned short expect[] = { 0, 1, 2, 3, 50, 51, 100, 101, 102, 103, 104, 105 };
+  unsigned short data[16];
+  int lane, size, i;
+
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANES, umem, &lanes), 0);
+  KUNIT_EXPECT_EQ(test, dev->NumLanes, 3u);
+
+  // Bulk first, then urgent (cut to lane 0's size), then normal
+  lane = 2;
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANE, umem, &lane), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 100, 6), 6);
+  // GETBUFSIZE / SETBUFSIZE work on the caller's lane, so a saved size can be restored
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCGETBUFSIZE, umem, &size), 0);
+  KUNIT_EXPECT_EQ(test, size, 16);
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCGETBUFSIZE, umem, &size), 0);
+  KUNIT_EXPECT_EQ(test, size, 4);
+  lane = 0;
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANE, umem, &lane), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 6), 4);
+  lane = 1;
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANE, umem, &lane), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 50, 2), 2);
+
+  // Lanes cannot be re-partitioned while they hold data
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANES, umem, &lanes), (long)-EBUSY);
+
+  // Readers drain the highest-priority non-empty lane first
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 16), 12);
+  for (i = 0; i < 12; i++)
+    KUNIT_EXPECT_EQ(test, data[i], expect[i]);
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCGETLANES, umem, &lanes), 0);
+  KUNIT_EXPECT_EQ(test, lanes.highwater[0], 4u);
+  KUNIT_EXPECT_EQ(test, lanes.highwater[1], 2u);
+  KUNIT_EXPECT_EQ(test, lanes.highwater[2], 6u);
+
+  // A lane beyond the active ones falls back to the lowest priority
+  lane = BUF_MAX_LANES - 1;
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANE, umem, &lane), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 7, 1), 1);
+  KUNIT_EXPECT_EQ(test, BufNumData(&dev->Lanes[2]), 1);
+  lane = BUF_MAX_LANES;
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETLANE, umem, &lane), (long)-EINVAL);
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETLANE, umem, &lane), (long)-EBADF);
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 16), 1);
+}
+
+static void buf_test_lane_writers(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *urgent = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  struct file *bulk, *rd = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  char __user *umem = buf_test_umem(test);
+  struct buf_lanes lanes = { .nlanes = 3, .size = { 4, 4, 4 } };
+  unsigned short data[8];
+  int lane;
+
+  // A single lane keeps a single writer
+  KUNIT_EXPECT_EQ(test, buf_dev_open(dev, &(struct file){ .f_flags = O_WRONLY }), -EBUSY);
+
+  // With lanes, each new writer gets the highest-priority free lane
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, urgent, BUF_IOCSETLANES, umem, &lanes), 0);
+  bulk = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  KUNIT_EXPECT_EQ(test, ((struct Buf_File *)bulk->private_data)->Lane, 1u);
+  lane = 0;
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, bulk, BUF_IOCSETLANE, umem, &lane), (long)-EBUSY);
+  lane = BUF_MAX_LANES - 1;  // falls back to lane 2
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, bulk, BUF_IOCSETLANE, umem, &lane), 0);
+  lane = 2;
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, urgent, BUF_IOCSETLANE, umem, &lane), (long)-EBUSY);
+
+  // Both producers write at once; the urgent data is read first
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, bulk, umem, 100, 2), 2);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, urgent, umem, 0, 2), 2);
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 8), 4);
+  KUNIT_EXPECT_EQ(test, data[0], 0);
+  KUNIT_EXPECT_EQ(test, data[2], 100);
+
+  // Lane 1 is free for a third writer, then every lane is taken
+  KUNIT_EXPECT_EQ(test, ((struct Buf_File *)buf_test_open(test, dev, O_WRONLY)->private_data)->Lane, 1u);
+  KUNIT_EXPECT_EQ(test, buf_dev_open(dev, &(struct file){ .f_flags = O_WRONLY }), -EBUSY);
+
+  // Two lanes would put the writers of lanes 1 and 7 together; three lanes of another size are fine
+  lanes.nlanes = 2;
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, urgent, BUF_IOCSETLANES, umem, &lanes), (long)-EBUSY);
+  lanes = (struct buf_lanes){ .nlanes = 3, .size = { 8, 8, 8 } };
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, urgent, BUF_IOCSETLANES, umem, &lanes), 0);
+}
+
+
+/* --- Écriture différée (write-behind) --- */
+
+static void buf_test_behind(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *wr = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  struct file *rd = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  struct Buf_File *bf = wr->private_data;
+  char __user *umem = buf_test_umem(test);
+  unsigned short data[8];
+  unsigned int blocks;
+  int i, n;
+
+  KUNIT_ASSERT_EQ(test, BufResize(&dev->Lanes[0], 4), 0);
+  KUNIT_ASSERT_EQ(test, buf_behind_set(bf, 8), 0);
+
+  // The ring takes 4, the staging queue 6; then only 2 more fit and the rest is refused
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 10), 10);
+  KUNIT_EXPECT_EQ(test, BufNumData(&dev->Lanes[0]), 4);
+  KUNIT_EXPECT_EQ(test, BufNumData(&bf->Staged), 6);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 10, 4), 2);
+  KUNIT_EXPECT_EQ(test, bf->Overflows, 2u);
+  KUNIT_EXPECT_EQ(test, dev->WbOverflows, 2u);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 12, 1), -EAGAIN);
+
+  // Nothing can move while the ring is full; the queue cannot be resized while it holds data
+  KUNIT_EXPECT_EQ(test, buf_behind_flush(bf, 1), -EAGAIN);
+  KUNIT_EXPECT_EQ(test, buf_behind_set(bf, 16), -EBUSY);
+
+  // Each read makes room for 4 staged items, in order (the drain work may move them first)
+  for (i = 0; i < 3; i++) {
+    KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 8), 4);
+    for (n = 0; n < 4; n++)
+      KUNIT_EXPECT_EQ(test, data[n], 4 * i + n);
+    KUNIT_EXPECT_EQ(test, buf_behind_flush(bf, 1), i < 1 ? -EAGAIN : 0);
+  }
+  KUNIT_EXPECT_TRUE(test, bf->Staged.BufEmpty);
+  KUNIT_EXPECT_EQ(test, BufNumData(&dev->Lanes[0]), 0);
+
+  // Disabled: writes go to the ring again, and a full ring refuses them
+  KUNIT_ASSERT_EQ(test, buf_behind_set(bf, 0), 0);
+  KUNIT_EXPECT_NULL(test, bf->Staged.Buffer);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 6), 4);
+
+  // A long write stops at the first chunk the full queue turns away: only that chunk overflows
+  KUNIT_ASSERT_EQ(test, buf_behind_set(bf, 8), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 40), 8);
+  KUNIT_EXPECT_EQ(test, bf->Overflows, 3u + (READWRITE_BUFSIZE - 8));
+
+  // Draining into a full ring stops there: it is not counted as a writer block
+  blocks = dev->WriterBlocks;
+  KUNIT_EXPECT_EQ(test, buf_behind_flush(bf, 1), -EAGAIN);
+  KUNIT_EXPECT_EQ(test, dev->WriterBlocks, blocks);
+}
+
+
+/* --- Limitation de débit --- */
+
+static void buf_test_rate(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *wr = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  char __user *umem = buf_test_umem(test);
+  struct buf_ratelimit rl = { .rate = 1, .burst = 5 };
+  struct BufBucket b;
+
+  // Bucket arithmetic on a synthetic clock: 1000 items/s, 10 deep
+  buf_bucket_set(&b, 1000, 10);
+  KUNIT_EXPECT_EQ(test, buf_bucket_avail(&b), 10u);
+  b.Tokens = 0;
+  b.Last = 0;
+  buf_bucket_refill(&b, NSEC_PER_MSEC);
+  KUNIT_EXPECT_EQ(test, buf_bucket_avail(&b), 1u);
+  KUNIT_EXPECT_EQ(test, buf_bucket_wait(&b, 3), 2ull * NSEC_PER_MSEC);
+  KUNIT_EXPECT_EQ(test, buf_bucket_wait(&b, 100), 9ull * NSEC_PER_MSEC);  // capped at Burst
+  buf_bucket_refill(&b, NSEC_PER_SEC);
+  KUNIT_EXPECT_EQ(test, buf_bucket_avail(&b), 10u);
+  buf_bucket_refill(&b, U64_MAX / 2);  // long idle period: capped, no overflow
+  KUNIT_EXPECT_EQ(test, buf_bucket_avail(&b), 10u);
+  buf_bucket_set(&b, 0, 10);
+  KUNIT_EXPECT_EQ(test, buf_bucket_avail(&b), UINT_MAX);
+  KUNIT_EXPECT_EQ(test, buf_bucket_wait(&b, 1000), 0ull);
+
+  // A writer limited to 1 item/s gets its burst, then a short count, then -EAGAIN
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETRATE, umem, &rl), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 10), 5);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 1), -EAGAIN);
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCGETRATE, umem, &rl), 0);
+  KUNIT_EXPECT_EQ(test, rl.refused, 2u);
+  KUNIT_EXPECT_EQ(test, rl.throttled, 0u);
+  KUNIT_EXPECT_EQ(test, dev->RlRefused, 2u);
+  KUNIT_EXPECT_EQ(test, buf_num_data(dev), 5);
+
+  // The device bucket applies on top of the writer's
+  rl = (struct buf_ratelimit){ .rate = 1, .burst = 0 };
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETRATE, umem, &rl), (long)-EINVAL);
+  rl = (struct buf_ratelimit){ 0 };
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETRATE, umem, &rl), 0);
+  rl = (struct buf_ratelimit){ .rate = 1, .burst = 3 };
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETDEVRATE, umem, &rl), 0);
+  KUNIT_EXPECT_EQ(test, buf_test_write(test, wr, umem, 0, 10), 3);
+  KUNIT_EXPECT_EQ(test, buf_num_data(dev), 8);
+}
+
+
+/* --- Auto-dimensionnement --- */
+
+static void buf_test_autosize(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned long win = msecs_to_jiffies(1000);
+  int i;
+
+  KUNIT_ASSERT_EQ(test, BufResize(Buf, 16), 0);
+  // Policy set directly (no tick): windows only close when AutoWinEnd is moved back
+  dev->Auto = (struct buf_autosize){ .enable = 1, .min_size = 16, .max_size = 64, .window_ms = 1000, .grow_blocks = 2 };
+  dev->AutoWinEnd = jiffies + 1000 * win;
+
+  // Every grow_blocks writer blocks double the lane, up to max_size
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 0);
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 1);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 32u);
+  for (i = 0; i < 4; i++)
+    buf_autosize(dev, 0);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 64u);
+  KUNIT_EXPECT_EQ(test, dev->AutoGrows, 2u);
+  KUNIT_EXPECT_EQ(test, dev->WriterBlocks, 6u);
+
+  // The memory budget caps the growth below the doubling (the blocks at max_size still count)
+  dev->Auto.max_size = 1024;
+  dev->Auto.budget_bytes = 160;
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 1);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 80u);
+  buf_autosize(dev, 0);
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 0);
+
+  // Lanes adding up to more than 4 GiB are over any budget (sizes only: the lanes are never touched)
+  dev->NumLanes = BUF_MAX_LANES;
+  for (i = 1; i < BUF_MAX_LANES; i++)
+    dev->Lanes[i].BufSize = 0x12492492;
+  buf_autosize(dev, 0);
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 0);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 80u);
+  for (i = 1; i < BUF_MAX_LANES; i++)
+    dev->Lanes[i].BufSize = 0;
+  dev->NumLanes = 1;
+
+  // A busy window keeps the size
+  for (i = 0; i < 60; i++)
+    KUNIT_ASSERT_EQ(test, buf_enqueue(dev, 0, &(unsigned short){ i }), 0);
+  dev->AutoWinEnd = jiffies - 10 * win;
+  buf_autosize(dev, -1);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 80u);
+
+  // Twenty idle windows: one halving per BUF_AUTO_SHRINK_WINDOWS, down to min_size
+  while (buf_dequeue(dev, &(unsigned short){ 0 }) == 0)
+    ;
+  Buf->WinHigh = 0;
+  dev->AutoWinEnd = jiffies - 20 * win;
+  buf_autosize(dev, -1);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 16u);
+  KUNIT_EXPECT_EQ(test, dev->AutoShrinks, 3u);
+  KUNIT_EXPECT_EQ(test, dev->AutoLastSize, 16u);
+
+  // Disabled: blocks are still counted, nothing changes
+  dev->Auto.enable = 0;
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 0);
+  KUNIT_EXPECT_EQ(test, buf_autosize(dev, 0), 0);
+  KUNIT_EXPECT_EQ(test, Buf->BufSize, 16u);
+}
+
+
+/* --- Lecture réduite --- */
+
+static void buf_test_readmode(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct file *wr = buf_test_open(test, dev, O_WRONLY | O_NONBLOCK);
+  struct file *rd = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  struct file *raw = buf_test_open(test, dev, O_RDONLY | O_NONBLOCK);
+  struct buf_readmode mode = { .mode = BUF_READ_MINMAXMEAN, .window = 4 };
+  static const unsigned short in[] = { 5, 1, 9, 3, 2, 2, 2, 2, 7 };
+  char __user *umem = buf_test_umem(test);
+  unsigned short data[16];
+  int i;
+
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), 0);
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, in, sizeof(in)), 0);
+  KUNIT_ASSERT_EQ(test, buf_write(wr, umem, sizeof(in), &wr->f_pos), (ssize_t)sizeof(in));
+
+  // {min, max, mean, count} per full window; a partial window gives nothing yet
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 16), 8);
+  KUNIT_EXPECT_EQ(test, data[0], 1);
+  KUNIT_EXPECT_EQ(test, data[1], 9);
+  KUNIT_EXPECT_EQ(test, data[2], 4);
+  KUNIT_EXPECT_EQ(test, data[3], 4);
+  KUNIT_EXPECT_EQ(test, data[4], 2);
+  KUNIT_EXPECT_EQ(test, data[6], 2);
+  KUNIT_EXPECT_EQ(test, buf_test_read(test, rd, umem, data, 16), -EAGAIN);
+  KUNIT_EXPECT_EQ(test, buf_test_read(test, rd, umem, data, 3), -EINVAL);  // less than a record
+
+  // The ring itself is untouched: a raw reader still gets every sample
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, raw, umem, data, 16), 9);
+  for (i = 0; i < 9; i++)
+    KUNIT_EXPECT_EQ(test, data[i], in[i]);
+
+  // Decimation keeps the first sample of each window
+  mode = (struct buf_readmode){ .mode = BUF_READ_DECIMATE, .window = 3 };
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), 0);
+  KUNIT_ASSERT_EQ(test, buf_test_write(test, wr, umem, 10, 6), 6);
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 16), 2);
+  KUNIT_EXPECT_EQ(test, data[0], 10);
+  KUNIT_EXPECT_EQ(test, data[1], 13);
+
+  // Threshold keeps the samples strictly above it
+  mode = (struct buf_readmode){ .mode = BUF_READ_THRESHOLD, .threshold = 12 };
+  KUNIT_ASSERT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), 0);
+  KUNIT_ASSERT_EQ(test, buf_test_write(test, wr, umem, 11, 4), 4);
+  KUNIT_ASSERT_EQ(test, buf_test_read(test, rd, umem, data, 16), 2);
+  KUNIT_EXPECT_EQ(test, data[0], 13);
+  KUNIT_EXPECT_EQ(test, data[1], 14);
+
+  // Invalid modes; a writer-only file has no read mode
+  mode = (struct buf_readmode){ .mode = BUF_READ_MINMAXMEAN, .window = 0 };
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), (long)-EINVAL);
+  mode = (struct buf_readmode){ .mode = BUF_READ_MINMAXMEAN, .window = USHRT_MAX + 1 };
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), (long)-EINVAL);
+  mode = (struct buf_readmode){ .mode = 42 };
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, rd, BUF_IOCSETREADMODE, umem, &mode), (long)-EINVAL);
+  KUNIT_EXPECT_EQ(test, buf_test_ioctl(test, wr, BUF_IOCSETREADMODE, umem, &mode), (long)-EBADF);
+}
+
+
+/* --- Export / import d'une image --- */
+
+static void buf_test_image(struct kunit *test) {
+  struct Buf_Dev *dev = buf_test_dev(test), *dev2 = buf_test_dev(test);
+  char __user *umem = buf_test_umem(test);
+  struct buf_image img = { .addr = (unsigned long)umem, .len = BUF_TEST_UMEM };
+  struct buf_image_hdr hdr;
+  unsigned short v, in = 0;
+  unsigned int i;
+
+  // Source: 16 items of size, 3 already read and kept, 7 unread
+  KUNIT_ASSERT_EQ(test, BufResize(&dev->Lanes[0], 16), 0);
+  dev->Lanes[0].Retain = 1;
+  for (i = 0; i < 10; i++, in++)
+    KUNIT_ASSERT_EQ(test, buf_enqueue(dev, 0, &in), 0);
+  for (i = 0; i < 3; i++)
+    KUNIT_ASSERT_EQ(test, buf_dequeue(dev, &v), 0);
+
+  KUNIT_ASSERT_EQ(test, buf_export(dev, &img), 0);
+  KUNIT_EXPECT_EQ(test, img.len, (__u64)(sizeof(hdr) + 10 * sizeof(unsigned short)));
+  KUNIT_EXPECT_EQ(test, buf_num_data(dev), 7);  // export consumes nothing
+
+  // Round trip into an empty device, then refused on a non-empty one
+  KUNIT_ASSERT_EQ(test, buf_import(dev2, &img), 0);
+  KUNIT_EXPECT_EQ(test, dev2->NumLanes, 1u);
+  KUNIT_EXPECT_EQ(test, dev2->Lanes[0].BufSize, 16u);
+  KUNIT_EXPECT_TRUE(test, dev2->Lanes[0].Retain);
+  KUNIT_EXPECT_EQ(test, dev2->Lanes[0].Retained, 3u);
+  KUNIT_EXPECT_EQ(test, dev2->Lanes[0].InSeq, 10ull);
+  KUNIT_EXPECT_EQ(test, buf_import(dev2, &img), -EBUSY);
+  for (i = 3; i < 10; i++) {
+    KUNIT_ASSERT_EQ(test, buf_dequeue(dev2, &v), 0);
+    KUNIT_EXPECT_EQ(test, v, i);
+  }
+  KUNIT_EXPECT_TRUE(test, buf_lanes_empty(dev2));
+  KUNIT_EXPECT_EQ(test, buf_import(dev2, &(struct buf_image){ .addr = img.addr, .len = img.len - 2 }), -EINVAL);
+
+  // Forged headers: 8 lanes whose counts add up past 32 bits, an oversized packed lane
+  img.len = BUF_TEST_UMEM;
+  memset(&hdr, 0, sizeof(hdr));
+  hdr.magic = BUF_IMAGE_MAGIC;
+  hdr.version = BUF_IMAGE_VERSION;
+  hdr.nlanes = BUF_MAX_LANES;
+  for (i = 0; i < BUF_MAX_LANES; i++)
+    hdr.lane[i] = (struct buf_image_lane){ .size = U32_MAX, .numdata = U32_MAX / 2 + 1, .retained = U32_MAX / 2 };
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, &hdr, sizeof(hdr)), 0);
+  KUNIT_EXPECT_EQ(test, buf_import(dev2, &img), -EINVAL);
+  memset(hdr.lane, 0, sizeof(hdr.lane));
+  hdr.nlanes = 1;
+  hdr.flags = BUF_IMAGE_PACKED;
+  hdr.lane[0] = (struct buf_image_lane){ .size = BUF_PACK_MINSIZE, .numdata = U32_MAX };
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, &hdr, sizeof(hdr)), 0);
+  KUNIT_EXPECT_EQ(test, buf_import(dev2, &img), -EINVAL);
+
+  // Packed items that do not compress into the pool: -ENOSPC, device left as it was
+  hdr.lane[0].numdata = 200;
+  KUNIT_ASSERT_EQ(test, copy_to_user(umem, &hdr, sizeof(hdr)), 0);
+  for (i = 0; i < 200; i++)
+    KUNIT_ASSERT_EQ(test, put_user(buf_test_noise(i), (unsigned short __user *)(umem + sizeof(hdr)) + i), 0);
+  KUNIT_EXPECT_EQ(test, buf_import(dev2, &img), -ENOSPC);
+  KUNIT_EXPECT_EQ(test, dev2->Lanes[0].BufSize, 16u);
+  KUNIT_EXPECT_FALSE(test, dev2->Lanes[0].Packed);
+
+  // The same count of a slow signal fits, and comes back exact
+  for (i = 0; i < 200; i++)
+    KUNIT_ASSERT_EQ(test, put_user(buf_test_smooth(i), (unsigned short __user *)(umem + sizeof(hdr)) + i), 0);
+  KUNIT_ASSERT_EQ(test, buf_import(dev2, &img), 0);
+  KUNIT_EXPECT_TRUE(test, dev2->Lanes[0].Packed);
+  KUNIT_EXPECT_EQ(test, buf_num_data(dev2), 200);
+  for (i = 0; i < 200; i++) {
+    KUNIT_ASSERT_EQ(test, buf_dequeue(dev2, &v), 0);
+    KUNIT_EXPECT_EQ(test, v, buf_test_smooth(i));
+  }
+}
+
+
+/* --- Mesures (ns par donnée) --- */
+
+// Fills then drains one lane through buf_enqueue()/buf_dequeue(), as read() and write() do,
+// until about BUF_TEST_BENCH_ITEMS items went through. SemBuf is not taken: the cost measured
+// is the ring itself. Marked slow; skip with --filter "speed>slow".
+#define BUF_TEST_BENCH_ITEMS (1u << 22)
+
+static void buf_test_bench(struct kunit *test) {
+  static const unsigned int sizes[] = { 64, 1024, 65536 };
+  struct Buf_Dev *dev = buf_test_dev(test);
+  struct BufStruct *Buf = &dev->Lanes[0];
+  unsigned int s, packed, n, i, total, in100, out100;
+  u64 t0, t_in, t_out;
+  unsigned short v;
+
+  for (packed = 0; packed <= 1; packed++) {
+    for (s = 0; s < ARRAY_SIZE(sizes); s++) {
+      Buf->Packed = 0;
+      BufReset(Buf);
+      KUNIT_ASSERT_EQ(test, BufResize(Buf, sizes[s]), 0);
+      Buf->Packed = packed;
+      BufReset(Buf);
+      t_in = t_out = 0;
+      for (total = 0; total < BUF_TEST_BENCH_ITEMS; total += n) {
+        t0 = ktime_get_ns();
+        for (n = 0; buf_enqueue(dev, 0, &(unsigned short){ buf_test_smooth(total + n) }) == 0; n++)
+          ;
+        t_in += ktime_get_ns() - t0;
+        t0 = ktime_get_ns();
+        for (i = 0; i < n; i++)
+          buf_dequeue(dev, &v);
+        t_out += ktime_get_ns() - t0;
+        KUNIT_ASSERT_TRUE(test, Buf->BufEmpty);
+        cond_resched();
+      }
+      // Hundredths of ns per item
+      in100 = div_u64(t_in * 100, total);
+      out100 = div_u64(t_out * 100, total);
+      kunit_info(test, "%s size %u: enqueue %u.%02u ns/item, dequeue %u.%02u ns/item\n",
+                 packed ? "packed" : "raw", sizes[s], in100 / 100, in100 % 100, out100 / 100, out100 % 100);
+    }
+  }
+}
+
+
+static struct kunit_case buf_driver_test_cases[] = {
+  KUNIT_CASE(buf_test_wrap),
+  KUNIT_CASE(buf_test_resize),
+  KUNIT_CASE(buf_test_set_bufsize),
+  KUNIT_CASE(buf_test_packed),
+  KUNIT_CASE(buf_test_retain_llseek),
+  KUNIT_CASE(buf_test_rw),
+  KUNIT_CASE(buf_test_image),
+  KUNIT_CASE(buf_test_lanes),
+  KUNIT_CASE(buf_test_lane_writers),
+  KUNIT_CASE(buf_test_behind),
+  KUNIT_CASE(buf_test_rate),
+  KUNIT_CASE(buf_test_autosize),
+  KUNIT_CASE(buf_test_readmode),
+  KUNIT_CASE_SLOW(buf_test_bench),
+  {}
+};
+
+static struct kunit_suite buf_driver_test_suite = {
+  .name = "buf_driver",
+  .test_cases = buf_driver_test_cases,
+};
+
+kunit_test_suite(buf_driver_test_suite);
@@ -3,6 +3,7 @@
 
 #include <linux/ioctl.h>  // _IOR, _IOW, _IORW : macros are used to define IOCTL command numbers and their directions (read, write, or both).
 //we need these macros to create the IOCTL constants that userspace programs and the driver both understand.
+#include <linux/types.h>  // __u32, __u64 : fixed-size types shared by user space and the kernel
 
 /* Magic number for our device */
 #define BUF_IOC_MAGIC 'b'
@@ -20,9 +21,181 @@
 #define BUF_IOCGETBUFSIZE    _IOR(BUF_IOC_MAGIC, 2, int)  /* user reads current buffer size.*/
 #define BUF_IOCSETBUFSIZE    _IOW(BUF_IOC_MAGIC, 3, int)  /* user writes new buffer size to kernel.*/
 
+// io_uring passthrough (IORING_OP_URING_CMD).
+// These commands share the IOCTL command space but are only accepted through io_uring:
+// sqe->cmd_op holds the command and the 16-byte sqe->cmd area holds a struct buf_uring_cmd.
+// The CQE result is the number of items transferred (or the item count for STATUS), or -errno.
+// DEQUEUE completes as soon as data is available, ENQUEUE once the whole batch is in the ring.
+#define BUF_URING_MAXITEMS 4096 /* largest io_uring batch (items) */
+struct buf_uring_cmd {
+  __u64 addr;   /* user buffer of unsigned short items */
+  __u32 nitems; /* number of items in the batch (1..BUF_URING_MAXITEMS), unused by STATUS */
+  __u32 flags;  /* reserved, must be 0 */
+};
+#define BUF_IOCURING_ENQUEUE _IOW(BUF_IOC_MAGIC, 4, struct buf_uring_cmd)  /* batch write into the ring.*/
+#define BUF_IOCURING_DEQUEUE _IOR(BUF_IOC_MAGIC, 5, struct buf_uring_cmd)  /* batch read from the ring.*/
+#define BUF_IOCURING_PEEK    _IOR(BUF_IOC_MAGIC, 6, struct buf_uring_cmd)  /* copy oldest items without consuming them.*/
+#define BUF_IOCURING_STATUS  _IOR(BUF_IOC_MAGIC, 7, struct buf_uring_cmd)  /* number of data items in the buffer.*/
+
+// Device statistics, filled by BUF_IOCGETSTATS.
+struct buf_stats {
+  __u32 numdata;         /* logical number of data items in the buffer */
+  __u32 bufsize;         /* buffer size (items; in packed mode the pool is bufsize * 2 bytes) */
+  __u32 packed;          /* 1 if compressed storage is enabled */
+  __u32 comp_ratio_x100; /* raw_bytes / packed_bytes * 100 (100 = no gain) */
+  __u64 raw_bytes;       /* bytes of samples packed into blocks since packing was enabled */
+  __u64 packed_bytes;    /* bytes of the encoded blocks since packing was enabled */
+  __u32 writer_blocks;   /* times a writer found its lane full (write() or io_uring ENQUEUE) */
+  __u32 auto_grows;      /* lanes grown by the auto-sizing policy */
+  __u32 auto_shrinks;    /* lanes shrunk by the auto-sizing policy */
+  __u32 auto_lastsize;   /* size chosen by the last auto-sizing decision (0 = none yet) */
+  __u32 spin_hits;       /* busy-polls that saw data/space before their budget ran out */
+  __u32 spin_misses;     /* busy-polls that fell back to the wait queue */
+  __u32 wb_pending;      /* items waiting in write-behind staging queues */
+  __u32 wb_overflows;    /* items refused by write() because a staging queue was full */
+  __u32 wb_lost;         /* staged items discarded when their writer closed without fsync() */
+  __u32 wb_drains;       /* runs of the write-behind drain work */
+  __u32 rl_throttled;    /* times a writer slept because a rate limit ran out of tokens */
+  __u32 rl_refused;      /* writes cut short or refused (-EAGAIN) by a rate limit in non-blocking mode */
+  __u64 rl_wait_ns;      /* total sleep requested by the rate limits (ns) */
+};
+#define BUF_IOCGETSTATS      _IOR(BUF_IOC_MAGIC, 8, struct buf_stats)  /* user reads device statistics.*/
+// Compressed storage: blocks of 64 samples are delta-encoded and bit-packed on write, decoded on read.
+// The data stream seen by readers is unchanged. Needs CAP_SYS_RESOURCE, an empty buffer and bufsize >= 64.
+#define BUF_IOCSETPACKED     _IOW(BUF_IOC_MAGIC, 9, int)  /* user enables (1) or disables (0) compressed storage.*/
+
+// Per-open read modes. A reduced reader does not consume the ring: it sees every sample written
+// after BUF_IOCSETREADMODE and reads only the resulting records, so full-rate readers are unaffected.
+#define BUF_READ_RAW        0 /* every sample, taken from the ring (default) */
+#define BUF_READ_DECIMATE   1 /* first sample of each window of `window` samples */
+#define BUF_READ_MINMAXMEAN 2 /* one record {min, max, mean, count} of 4 unsigned short per window */
+#define BUF_READ_THRESHOLD  3 /* samples strictly greater than `threshold` */
+struct buf_readmode {
+  __u32 mode;      /* BUF_READ_* */
+  __u32 window;    /* window size for DECIMATE (> 0) and MINMAXMEAN (1..65535) */
+  __u32 threshold; /* threshold for THRESHOLD */
+  __u32 dropped;   /* GET only: records lost because the reader was too slow */
+};
+#define BUF_IOCSETREADMODE   _IOW(BUF_IOC_MAGIC, 10, struct buf_readmode)  /* user sets the read mode of this open file.*/
+#define BUF_IOCGETREADMODE   _IOR(BUF_IOC_MAGIC, 11, struct buf_readmode)  /* user reads the read mode of this open file.*/
+
+// Priority lanes: the ring can be split into up to BUF_MAX_LANES sub-rings, each with its own size.
+// A writer selects its lane with BUF_IOCSETLANE; readers always drain the highest non-empty lane first.
+// Each lane has at most one writer: open() gives a writer the highest-priority free lane (-EBUSY if
+// none is left), and BUF_IOCSETLANE / BUF_IOCSETLANES fail with -EBUSY rather than share a lane.
+// Lane 0 has the highest priority. BUF_IOCGETBUFSIZE / BUF_IOCSETBUFSIZE read / resize the lane selected
+// by the caller (lane 0 for a reader); BUF_IOCGETLANES gives every lane.
+#define BUF_MAX_LANES 8
+struct buf_lanes {
+  __u32 nlanes;                    /* number of lanes (1..BUF_MAX_LANES) */
+  __u32 size[BUF_MAX_LANES];       /* capacity of each lane (items) */
+  __u32 numdata[BUF_MAX_LANES];    /* GET only: items in each lane */
+  __u32 highwater[BUF_MAX_LANES];  /* GET only: highest occupancy of each lane since configuration */
+};
+#define BUF_IOCSETLANES      _IOW(BUF_IOC_MAGIC, 12, struct buf_lanes)  /* user configures the lanes (admin, empty buffer).*/
+#define BUF_IOCGETLANES      _IOR(BUF_IOC_MAGIC, 13, struct buf_lanes)  /* user reads the lanes and their occupancy.*/
+#define BUF_IOCSETLANE       _IOW(BUF_IOC_MAGIC, 14, int)  /* user selects the lane of this open file's writes.*/
+
+// Retention mode: items stay in the ring after being read, until a writer needs their slot.
+// Every item has a 64-bit sequence number; lseek() positions the (shared) read position by sequence
+// number: SEEK_SET = checkpoint, SEEK_DATA with 0 = oldest retained item, SEEK_END with 0 = newest.
+// Needs a single lane and raw storage. Without retention lseek() fails with ESPIPE.
+struct buf_seq {
+  __u64 oldest; /* sequence number of the oldest retained item */
+  __u64 next;   /* sequence number of the next item to read */
+  __u64 newest; /* sequence number the next written item will get */
+};
+#define BUF_IOCSETRETAIN     _IOW(BUF_IOC_MAGIC, 15, int)  /* user enables (1) or disables (0) retention (admin).*/
+#define BUF_IOCGETSEQ        _IOR(BUF_IOC_MAGIC, 16, struct buf_seq)  /* user reads the sequence window.*/
+
+// Auto-sizing policy: a lane whose writers find it full grow_blocks times within one window doubles
+// (up to max_size and the memory budget); a lane whose occupancy stays below a quarter of its size
+// for BUF_AUTO_SHRINK_WINDOWS windows in a row is halved (down to min_size). Packed lanes are left alone.
+// Decisions are counted in struct buf_stats. Needs CAP_SYS_RESOURCE; disabled by default.
+#define BUF_AUTO_SHRINK_WINDOWS 4
+struct buf_autosize {
+  __u32 enable;       /* 1 = policy active */
+  __u32 min_size;     /* smallest lane size (items, > 0) */
+  __u32 max_size;     /* largest lane size (items, >= min_size) */
+  __u32 budget_bytes; /* cap on the memory of all lanes together (0 = max_size only) */
+  __u32 window_ms;    /* observation window (> 0) */
+  __u32 grow_blocks;  /* writer block events within one window that grow a lane (> 0) */
+};
+#define BUF_IOCSETAUTOSIZE   _IOW(BUF_IOC_MAGIC, 17, struct buf_autosize)  /* user sets the auto-sizing policy (admin).*/
+#define BUF_IOCGETAUTOSIZE   _IOR(BUF_IOC_MAGIC, 18, struct buf_autosize)  /* user reads the auto-sizing policy.*/
+
+// Busy-poll: a blocking reader on an empty ring, or a writer on a full lane, first spins for up to
+// this many microseconds, checking the ring without the lock, before sleeping on the wait queue.
+// The device-wide default is the busy_poll module parameter (0 = off); -1 selects it again.
+#define BUF_BUSY_POLL_MAX 10000 /* largest budget (us) */
+#define BUF_IOCSETBUSYPOLL   _IOW(BUF_IOC_MAGIC, 19, int)  /* user sets the busy-poll budget of this open file (us).*/
+#define BUF_IOCGETBUSYPOLL   _IOR(BUF_IOC_MAGIC, 20, int)  /* user reads the effective busy-poll budget (us).*/
+
+// Write-behind: write() only copies into a per-open staging queue and returns at once; a kernel
+// work item moves the staged items into the ring, in order, as readers free space. Items that do
+// not fit in the staging queue are refused (short write, -EAGAIN if none fit) and counted.
+// fsync() or BUF_IOCWRFLUSH waits until every staged item is in the ring (ordering barrier).
+// io_uring ENQUEUE is refused on a write-behind open: it is already asynchronous.
+#define BUF_WRBEHIND_MAX 65536 /* largest staging queue (items) */
+struct buf_wrbehind {
+  __u32 size;      /* staging queue capacity (items), 0 = write-behind off */
+  __u32 pending;   /* GET only: items staged, not yet in the ring */
+  __u32 overflows; /* GET only: items refused because the staging queue was full */
+};
+#define BUF_IOCSETWRBEHIND   _IOW(BUF_IOC_MAGIC, 21, struct buf_wrbehind)  /* user enables/resizes/disables write-behind.*/
+#define BUF_IOCGETWRBEHIND   _IOR(BUF_IOC_MAGIC, 22, struct buf_wrbehind)  /* user reads the write-behind state.*/
+#define BUF_IOCWRFLUSH       _IO(BUF_IOC_MAGIC, 23)  /* user waits until staged items are in the ring.*/
+
+// Warm restart: the ring contents can be exported before rmmod and imported after insmod.
+// The image is a struct buf_image_hdr followed, lane by lane, by retained + numdata items
+// (unsigned short, oldest first). Export does not consume anything; stop the writers first.
+// Import needs CAP_SYS_RESOURCE and an empty device; it restores lanes, sizes, storage format,
+// retention and sequence numbers. Per-open state (read modes, write-behind queues) is not saved.
+#define BUF_IMAGE_MAGIC   0x49465542 /* "BUFI" */
+#define BUF_IMAGE_VERSION 1
+#define BUF_IMAGE_PACKED  0x1 /* flags: compressed storage */
+#define BUF_IMAGE_RETAIN  0x2 /* flags: retention mode */
+struct buf_image_lane {
+  __u32 size;      /* lane capacity (items) */
+  __u32 numdata;   /* unread items */
+  __u32 retained;  /* already-read items kept before them (retention mode) */
+  __u32 highwater; /* highest occupancy */
+  __u64 inseq;     /* sequence number of the next item written */
+};
+struct buf_image_hdr {
+  __u32 magic;     /* BUF_IMAGE_MAGIC */
+  __u32 version;   /* BUF_IMAGE_VERSION */
+  __u32 nlanes;    /* number of lanes (1..BUF_MAX_LANES) */
+  __u32 flags;     /* BUF_IMAGE_* */
+  struct buf_image_lane lane[BUF_MAX_LANES];
+};
+struct buf_image {
+  __u64 addr; /* user buffer holding the image */
+  __u64 len;  /* buffer size (bytes); EXPORT sets it to the image size, also on -ENOSPC */
+};
+#define BUF_IOCEXPORT        _IOWR(BUF_IOC_MAGIC, 24, struct buf_image)  /* user copies the ring contents out.*/
+#define BUF_IOCIMPORT        _IOW(BUF_IOC_MAGIC, 25, struct buf_image)  /* user restores exported contents (admin).*/
+
+// Rate limiting: token buckets on the items writers put in the ring. A bucket holds up to burst
+// items and refills at rate items per second. A write() that finds it empty sleeps until the next
+// token; with O_NONBLOCK it returns a short count, or -EAGAIN if nothing went in. Write-behind
+// consumes tokens when write() accepts the items. An io_uring ENQUEUE waits for its whole batch
+// (a batch above burst waits for a full bucket and leaves it in debt). Two buckets apply together:
+// the device-wide one (admin, kept across opens) and one per open file. rate 0 = no limit (default).
+struct buf_ratelimit {
+  __u32 rate;      /* items per second, 0 = no limit */
+  __u32 burst;     /* bucket depth (items, > 0 when rate > 0) */
+  __u32 throttled; /* GET only: times a writer slept for tokens (device: all writers, either bucket) */
+  __u32 refused;   /* GET only: non-blocking writes cut short or refused for lack of tokens (idem) */
+};
+#define BUF_IOCSETRATE       _IOW(BUF_IOC_MAGIC, 26, struct buf_ratelimit)  /* user limits the writes of this open file.*/
+#define BUF_IOCGETRATE       _IOR(BUF_IOC_MAGIC, 27, struct buf_ratelimit)  /* user reads the limit of this open file.*/
+#define BUF_IOCSETDEVRATE    _IOW(BUF_IOC_MAGIC, 28, struct buf_ratelimit)  /* user limits the writes of the device (admin).*/
+#define BUF_IOCGETDEVRATE    _IOR(BUF_IOC_MAGIC, 29, struct buf_ratelimit)  /* user reads the device-wide limit.*/
+
 // The maximum command number defined for this device.
 // Useful in your buf_ioctl() function to validate commands
 // Ensures the user doesn’t call undefined IOCTL commands.
-#define BUF_IOC_MAXNR 3 /* highest command number */
+#define BUF_IOC_MAXNR 29 /* highest command number */
 
 #endif /* BUF_IOCTL_H */
\ No newline at end of file
@@ -0,0 +1,71 @@
+#ifndef LIBBUF_H
+#define LIBBUF_H
+
+#include <stddef.h>     // size_t
+#include <sys/types.h>  // ssize_t
+#include "buf_ioctl.h"
+
+// libbuf : user-space client library for /dev/buf0 (link with -lbuf -pthread).
+// The writer and reader batch unsigned short items so that one system call moves many of them.
+// When the driver accepts io_uring commands (BUF_IOCURING_*), they are used automatically:
+// the writer sends a full batch without waiting for it, the reader gets whatever is available in one call.
+// Otherwise the library falls back to write() and read().
+// Unless stated otherwise, functions return 0 (or a count) on success and -1 with errno set on failure.
+
+#define LIBBUF_DEFAULT_BATCH 1024 /* items per batch when batch_items is 0 */
+
+struct buf_writer;
+struct buf_reader;
+
+/* --- Buffered writer --- */
+// flags : open() flags (O_WRONLY is added). With O_NONBLOCK, write() is used and unsent items stay buffered.
+// batch_items : size-based flush, capped to BUF_URING_MAXITEMS. flush_us : time-based flush (0 = off):
+// a thread owned by the writer sends the batch flush_us after its oldest item, without any call.
+// Calls on a writer are serialized with that thread (a lock per writer).
+struct buf_writer *buf_writer_open(const char *path, int flags, size_t batch_items, unsigned int flush_us);
+int buf_writer_put(struct buf_writer *w, unsigned short value);
+ssize_t buf_writer_write(struct buf_writer *w, const unsigned short *values, size_t n); /* returns items accepted */
+int buf_writer_poll(struct buf_writer *w);  /* flush now if the oldest buffered item is older than flush_us */
+int buf_writer_flush(struct buf_writer *w); /* barrier: returns once every item is in the ring */
+int buf_writer_close(struct buf_writer *w); /* flush, then close */
+int buf_writer_fd(struct buf_writer *w);
+
+/* --- Batched reader --- */
+// flags : open() flags (O_RDONLY is implied). batch_items : largest refill, capped to BUF_URING_MAXITEMS.
+struct buf_reader *buf_reader_open(const char *path, int flags, size_t batch_items);
+ssize_t buf_reader_read(struct buf_reader *r, unsigned short *values, size_t n); /* returns 1..n items */
+int buf_reader_get(struct buf_reader *r, unsigned short *value);
+int buf_reader_close(struct buf_reader *r);
+int buf_reader_fd(struct buf_reader *r);
+
+/* --- Typed IOCTL helpers (fd of /dev/buf0) --- */
+int buf_get_numdata(int fd);   /* returns the count */
+int buf_get_numreader(int fd); /* returns the count */
+int buf_get_bufsize(int fd);   /* returns the size */
+int buf_set_bufsize(int fd, int size);
+int buf_get_stats(int fd, struct buf_stats *stats);
+int buf_set_packed(int fd, int on);
+int buf_set_readmode(int fd, const struct buf_readmode *mode);
+int buf_get_readmode(int fd, struct buf_readmode *mode);
+int buf_set_lanes(int fd, const struct buf_lanes *lanes);
+int buf_get_lanes(int fd, struct buf_lanes *lanes);
+int buf_set_lane(int fd, int lane);
+int buf_set_retain(int fd, int on);
+int buf_get_seq(int fd, struct buf_seq *seq);
+int buf_set_autosize(int fd, const struct buf_autosize *policy);
+int buf_get_autosize(int fd, struct buf_autosize *policy);
+int buf_set_busypoll(int fd, int usec);
+int buf_get_busypoll(int fd); /* returns the effective budget (us) */
+int buf_set_wrbehind(int fd, unsigned int size); /* not on a buf_writer fd: io_uring ENQUEUE is refused */
+int buf_get_wrbehind(int fd, struct buf_wrbehind *wb);
+int buf_wrflush(int fd);
+int buf_set_rate(int fd, unsigned int rate, unsigned int burst); /* this open file, rate 0 = no limit */
+int buf_get_rate(int fd, struct buf_ratelimit *rl);
+int buf_set_devrate(int fd, unsigned int rate, unsigned int burst); /* whole device (admin) */
+int buf_get_devrate(int fd, struct buf_ratelimit *rl);
+
+/* --- Warm restart (BUF_IOCEXPORT / BUF_IOCIMPORT) --- */
+void *buf_export(int fd, size_t *len); /* malloc()ed image, NULL and errno on failure */
+int buf_import(int fd, const void *image, size_t len);
+
+#endif /* LIBBUF_H */
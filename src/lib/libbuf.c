@@ -0,0 +1,607 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "libbuf.h"
+
+/* --- Minimal io_uring (raw system calls, one command in flight) --- */
+struct buf_uring {
+    int fd;
+    unsigned int *sq_tail, *sq_mask, *sq_array;
+    unsigned int *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr, *cq_ptr;
+    size_t sq_len, cq_len, sqes_len;
+};
+
+static void uring_close(struct buf_uring *u) {
+    if (!u)
+        return;
+    if (u->sqes)
+        munmap(u->sqes, u->sqes_len);
+    if (u->cq_ptr && u->cq_ptr != u->sq_ptr)
+        munmap(u->cq_ptr, u->cq_len);
+    if (u->sq_ptr)
+        munmap(u->sq_ptr, u->sq_len);
+    close(u->fd);
+    free(u);
+}
+
+static struct buf_uring *uring_open(void) {
+    struct io_uring_params p;
+    struct buf_uring *u = calloc(1, sizeof(*u));
+
+    if (!u)
+        return NULL;
+    memset(&p, 0, sizeof(p));
+    u->fd = syscall(__NR_io_uring_setup, 2, &p);
+    if (u->fd < 0) {
+        free(u);
+        return NULL;
+    }
+    // Map the submission queue, the completion queue and the SQE array
+    u->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned int);
+    u->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        u->sq_len = u->cq_len = u->sq_len > u->cq_len ? u->sq_len : u->cq_len;
+    u->sq_ptr = mmap(NULL, u->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+    if (u->sq_ptr == MAP_FAILED) {
+        u->sq_ptr = NULL;
+        uring_close(u);
+        return NULL;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        u->cq_ptr = u->sq_ptr;
+    } else {
+        u->cq_ptr = mmap(NULL, u->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+        if (u->cq_ptr == MAP_FAILED) {
+            u->cq_ptr = NULL;
+            uring_close(u);
+            return NULL;
+        }
+    }
+    u->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        uring_close(u);
+        return NULL;
+    }
+    u->sq_tail = (unsigned int *)((char *)u->sq_ptr + p.sq_off.tail);
+    u->sq_mask = (unsigned int *)((char *)u->sq_ptr + p.sq_off.ring_mask);
+    u->sq_array = (unsigned int *)((char *)u->sq_ptr + p.sq_off.array);
+    u->cq_head = (unsigned int *)((char *)u->cq_ptr + p.cq_off.head);
+    u->cq_tail = (unsigned int *)((char *)u->cq_ptr + p.cq_off.tail);
+    u->cq_mask = (unsigned int *)((char *)u->cq_ptr + p.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *)((char *)u->cq_ptr + p.cq_off.cqes);
+    return u;
+}
+
+// Queue one BUF_IOCURING_* command on devfd; with wait, also wait for its completion in the same call.
+// Returns the CQE result when waiting, 0 once submitted otherwise, or -errno.
+static int uring_cmd(struct buf_uring *u, int devfd, unsigned int op, void *addr, unsigned int n, int wait) {
+    unsigned int tail = *u->sq_tail;
+    unsigned int idx = tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[idx];
+    struct buf_uring_cmd *cmd = (struct buf_uring_cmd *)sqe->cmd;
+    int ret;
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_URING_CMD;
+    sqe->fd = devfd;
+    sqe->cmd_op = op;
+    cmd->addr = (uintptr_t)addr;
+    cmd->nitems = n;
+    cmd->flags = 0;
+    u->sq_array[idx] = idx;
+    __atomic_store_n(u->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+    do {
+        ret = syscall(__NR_io_uring_enter, u->fd, 1, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (ret < 0 && errno == EINTR);
+    if (ret < 0)
+        return -errno;
+    return 0;
+}
+
+// Wait for the completion of the command in flight and return its result
+static int uring_reap(struct buf_uring *u) {
+    unsigned int head = *u->cq_head;
+    int ret;
+
+    while (head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE)) {
+        ret = syscall(__NR_io_uring_enter, u->fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR)
+            return -errno;
+    }
+    ret = u->cqes[head & *u->cq_mask].res;
+    __atomic_store_n(u->cq_head, head + 1, __ATOMIC_RELEASE);
+    return ret;
+}
+
+// io_uring is used only if the kernel and this driver both accept BUF_IOCURING_STATUS
+static struct buf_uring *uring_probe(int devfd) {
+    struct buf_uring *u;
+
+    // Non-blocking files get -EAGAIN from parked commands, which the simple path handles better
+    if (fcntl(devfd, F_GETFL) & O_NONBLOCK)
+        return NULL;
+    u = uring_open();
+    if (!u)
+        return NULL;
+    if (uring_cmd(u, devfd, BUF_IOCURING_STATUS, NULL, 0, 1) < 0 || uring_reap(u) < 0) {
+        uring_close(u);
+        return NULL;
+    }
+    return u;
+}
+
+static size_t batch_size(size_t batch_items) {
+    if (batch_items == 0)
+        batch_items = LIBBUF_DEFAULT_BATCH;
+    return batch_items > BUF_URING_MAXITEMS ? BUF_URING_MAXITEMS : batch_items;
+}
+
+static long long now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+/* --- Buffered writer --- */
+struct buf_writer {
+    int fd;
+    size_t batch;            // items per batch
+    unsigned int flush_us;   // time-based flush (0 = off)
+    unsigned short *buf[2];  // double buffer: one filling, one in flight (io_uring)
+    int cur;                 // buffer being filled
+    size_t fill;             // items in buf[cur]
+    long long first_us;      // time of the oldest buffered item
+    int inflight;            // an ENQUEUE of buf[!cur] is in flight
+    size_t inflight_n;       // its size
+    int err;                 // error of an asynchronous flush, reported by the next call
+    struct buf_uring *ring;  // NULL: write() transport
+    // Time-based flush (flush_us != 0): a thread sends the batch once its oldest item is due
+    pthread_t timer;
+    pthread_mutex_t lock;    // serializes the caller and the timer thread
+    pthread_cond_t wake;     // buffered items or close for the timer thread (CLOCK_MONOTONIC)
+    int closing;
+};
+
+static void *writer_timer(void *arg);
+
+struct buf_writer *buf_writer_open(const char *path, int flags, size_t batch_items, unsigned int flush_us) {
+    struct buf_writer *w = calloc(1, sizeof(*w));
+
+    if (!w)
+        return NULL;
+    w->batch = batch_size(batch_items);
+    w->flush_us = flush_us;
+    w->buf[0] = malloc(w->batch * sizeof(unsigned short));
+    w->buf[1] = malloc(w->batch * sizeof(unsigned short));
+    w->fd = open(path, (flags & ~O_ACCMODE) | O_WRONLY);
+    if (!w->buf[0] || !w->buf[1] || w->fd < 0) {
+        int saved = errno;
+        if (w->fd >= 0)
+            close(w->fd);
+        free(w->buf[0]);
+        free(w->buf[1]);
+        free(w);
+        errno = saved;
+        return NULL;
+    }
+    w->ring = uring_probe(w->fd);
+    pthread_mutex_init(&w->lock, NULL);
+    if (w->flush_us) {
+        pthread_condattr_t attr;
+        int ret;
+
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        pthread_cond_init(&w->wake, &attr);
+        pthread_condattr_destroy(&attr);
+        ret = pthread_create(&w->timer, NULL, writer_timer, w);
+        if (ret) {
+            pthread_cond_destroy(&w->wake);
+            pthread_mutex_destroy(&w->lock);
+            uring_close(w->ring);
+            close(w->fd);
+            free(w->buf[0]);
+            free(w->buf[1]);
+            free(w);
+            errno = ret;
+            return NULL;
+        }
+    }
+    return w;
+}
+
+// Wait for the ENQUEUE in flight, if any
+static int writer_wait(struct buf_writer *w) {
+    int ret;
+
+    if (!w->inflight)
+        return 0;
+    w->inflight = 0;
+    ret = uring_reap(w->ring);
+    if (ret < 0)
+        return ret;
+    return (size_t)ret == w->inflight_n ? 0 : -EIO;
+}
+
+// Send the filling buffer. With io_uring the call returns as soon as the batch is submitted.
+static int writer_send(struct buf_writer *w) {
+    unsigned short *data = w->buf[w->cur];
+    size_t done = 0;
+    ssize_t n;
+    int ret;
+
+    if (w->fill == 0)
+        return 0;
+    if (w->ring) {
+        // The other buffer becomes free once its batch is in the ring
+        ret = writer_wait(w);
+        if (ret == 0)
+            ret = uring_cmd(w->ring, w->fd, BUF_IOCURING_ENQUEUE, data, w->fill, 0);
+        if (ret < 0)
+            return ret;
+        w->inflight = 1;
+        w->inflight_n = w->fill;
+        w->cur = !w->cur;
+        w->fill = 0;
+        return 0;
+    }
+    while (done < w->fill) {
+        n = write(w->fd, data + done, (w->fill - done) * sizeof(unsigned short));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ret = -errno;
+            // O_NONBLOCK on a full ring: keep what was not sent
+            memmove(data, data + done, (w->fill - done) * sizeof(unsigned short));
+            w->fill -= done;
+            return ret;
+        }
+        done += n / sizeof(unsigned short);
+    }
+    w->fill = 0;
+    return 0;
+}
+
+// Timer thread: sleeps until the oldest buffered item is flush_us old, then sends the batch
+static void *writer_timer(void *arg) {
+    struct buf_writer *w = arg;
+    struct timespec ts;
+    long long due;
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    while (!w->closing) {
+        if (w->fill == 0) {
+            pthread_cond_wait(&w->wake, &w->lock);
+            continue;
+        }
+        due = w->first_us + w->flush_us;
+        if (now_us() < due) {
+            ts.tv_sec = due / 1000000;
+            ts.tv_nsec = due % 1000000 * 1000;
+            pthread_cond_timedwait(&w->wake, &w->lock, &ts);
+            continue;
+        }
+        ret = writer_send(w);
+        if (ret < 0) {
+            // The items stay buffered: retry after another flush_us, report a hard error on the next call
+            if (w->fill)
+                w->first_us = now_us();
+            if (ret != -EAGAIN && w->err == 0)
+                w->err = ret;
+        }
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+static int writer_check(struct buf_writer *w) {
+    int ret = w->err;
+
+    w->err = 0;
+    if (ret == 0 && w->flush_us && w->fill && now_us() - w->first_us >= w->flush_us)
+        ret = writer_send(w);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return 0;
+}
+
+static ssize_t writer_write(struct buf_writer *w, const unsigned short *values, size_t n) {
+    size_t done = 0, chunk;
+    int ret;
+
+    if (writer_check(w) < 0)
+        return -1;
+    while (done < n) {
+        if (w->fill == 0) {
+            w->first_us = now_us();
+            // A new batch starts: the timer thread waits for it
+            if (w->flush_us)
+                pthread_cond_signal(&w->wake);
+        }
+        chunk = w->batch - w->fill;
+        if (chunk > n - done)
+            chunk = n - done;
+        memcpy(w->buf[w->cur] + w->fill, values + done, chunk * sizeof(unsigned short));
+        w->fill += chunk;
+        done += chunk;
+        // Size-based flush
+        if (w->fill == w->batch) {
+            ret = writer_send(w);
+            // O_NONBLOCK and the ring is full: the items stay buffered, the caller keeps the rest
+            if (ret == -EAGAIN)
+                break;
+            if (ret < 0) {
+                // Hard error: the items of this call that were not sent are not accepted
+                if (chunk > w->fill)
+                    chunk = w->fill;
+                w->fill -= chunk;
+                done -= chunk;
+                // Reported now if nothing was accepted, otherwise by the next call
+                if (done == 0) {
+                    errno = -ret;
+                    return -1;
+                }
+                w->err = ret;
+                break;
+            }
+        }
+    }
+    if (done < n && done == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return done;
+}
+
+ssize_t buf_writer_write(struct buf_writer *w, const unsigned short *values, size_t n) {
+    ssize_t ret;
+
+    pthread_mutex_lock(&w->lock);
+    ret = writer_write(w, values, n);
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int buf_writer_put(struct buf_writer *w, unsigned short value) {
+    return buf_writer_write(w, &value, 1) == 1 ? 0 : -1;
+}
+
+int buf_writer_poll(struct buf_writer *w) {
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    ret = writer_check(w);
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+static int writer_flush(struct buf_writer *w) {
+    int ret = w->err;
+
+    w->err = 0;
+    if (ret == 0)
+        ret = writer_send(w);
+    if (ret == 0)
+        ret = writer_wait(w);
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return 0;
+}
+
+int buf_writer_flush(struct buf_writer *w) {
+    int ret;
+
+    pthread_mutex_lock(&w->lock);
+    ret = writer_flush(w);
+    pthread_mutex_unlock(&w->lock);
+    return ret;
+}
+
+int buf_writer_close(struct buf_writer *w) {
+    int ret, saved;
+
+    // Stop the timer thread first: the final flush runs in the caller
+    if (w->flush_us) {
+        pthread_mutex_lock(&w->lock);
+        w->closing = 1;
+        pthread_cond_signal(&w->wake);
+        pthread_mutex_unlock(&w->lock);
+        pthread_join(w->timer, NULL);
+        pthread_cond_destroy(&w->wake);
+    }
+    ret = writer_flush(w);
+    saved = errno;
+    pthread_mutex_destroy(&w->lock);
+    uring_close(w->ring);
+    close(w->fd);
+    free(w->buf[0]);
+    free(w->buf[1]);
+    free(w);
+    errno = saved;
+    return ret;
+}
+
+int buf_writer_fd(struct buf_writer *w) {
+    return w->fd;
+}
+
+/* --- Batched reader --- */
+struct buf_reader {
+    int fd;
+    size_t batch;            // largest refill
+    unsigned short *buf;
+    size_t pos, fill;        // items buf[pos..fill) not yet returned
+    struct buf_uring *ring;  // NULL: ioctl + read() transport
+};
+
+struct buf_reader *buf_reader_open(const char *path, int flags, size_t batch_items) {
+    struct buf_reader *r = calloc(1, sizeof(*r));
+
+    if (!r)
+        return NULL;
+    r->batch = batch_size(batch_items);
+    r->buf = malloc(r->batch * sizeof(unsigned short));
+    r->fd = open(path, (flags & ~O_ACCMODE) | O_RDONLY);
+    if (!r->buf || r->fd < 0) {
+        int saved = errno;
+        if (r->fd >= 0)
+            close(r->fd);
+        free(r->buf);
+        free(r);
+        errno = saved;
+        return NULL;
+    }
+    r->ring = uring_probe(r->fd);
+    return r;
+}
+
+// Get up to n items into data; returns the count or -errno
+static ssize_t reader_fetch(struct buf_reader *r, unsigned short *data, size_t n) {
+    ssize_t ret;
+    int avail;
+
+    // io_uring DEQUEUE returns as soon as some data is available, in one system call
+    if (r->ring) {
+        ret = uring_cmd(r->ring, r->fd, BUF_IOCURING_DEQUEUE, data, n, 1);
+        return ret < 0 ? ret : uring_reap(r->ring);
+    }
+    // A blocking read() waits for the full count, so ask only for what is already there
+    avail = buf_get_numdata(r->fd);
+    if (avail > 0 && (size_t)avail < n)
+        n = avail;
+    else if (avail <= 0)
+        n = 1;
+    do {
+        ret = read(r->fd, data, n * sizeof(unsigned short));
+    } while (ret < 0 && errno == EINTR);
+    return ret < 0 ? -errno : ret / (ssize_t)sizeof(unsigned short);
+}
+
+ssize_t buf_reader_read(struct buf_reader *r, unsigned short *values, size_t n) {
+    ssize_t ret;
+
+    if (n == 0)
+        return 0;
+    if (r->pos == r->fill) {
+        // Large requests go straight to the caller's buffer
+        if (n >= r->batch) {
+            ret = reader_fetch(r, values, n > BUF_URING_MAXITEMS ? BUF_URING_MAXITEMS : n);
+            goto out;
+        }
+        ret = reader_fetch(r, r->buf, r->batch);
+        if (ret <= 0)
+            goto out;
+        r->pos = 0;
+        r->fill = ret;
+    }
+    ret = r->fill - r->pos;
+    if ((size_t)ret > n)
+        ret = n;
+    memcpy(values, r->buf + r->pos, ret * sizeof(unsigned short));
+    r->pos += ret;
+out:
+    if (ret < 0) {
+        errno = -ret;
+        return -1;
+    }
+    return ret;
+}
+
+int buf_reader_get(struct buf_reader *r, unsigned short *value) {
+    return buf_reader_read(r, value, 1) == 1 ? 0 : -1;
+}
+
+int buf_reader_close(struct buf_reader *r) {
+    uring_close(r->ring);
+    close(r->fd);
+    free(r->buf);
+    free(r);
+    return 0;
+}
+
+int buf_reader_fd(struct buf_reader *r) {
+    return r->fd;
+}
+
+/* --- Typed IOCTL helpers --- */
+static int get_int(int fd, unsigned long cmd) {
+    int value;
+    return ioctl(fd, cmd, &value) < 0 ? -1 : value;
+}
+
+int buf_get_numdata(int fd) { return get_int(fd, BUF_IOCGETNUMDATA); }
+int buf_get_numreader(int fd) { return get_int(fd, BUF_IOCGETNUMREADER); }
+int buf_get_bufsize(int fd) { return get_int(fd, BUF_IOCGETBUFSIZE); }
+int buf_set_bufsize(int fd, int size) { return ioctl(fd, BUF_IOCSETBUFSIZE, &size); }
+int buf_get_stats(int fd, struct buf_stats *stats) { return ioctl(fd, BUF_IOCGETSTATS, stats); }
+int buf_set_packed(int fd, int on) { return ioctl(fd, BUF_IOCSETPACKED, &on); }
+int buf_set_readmode(int fd, const struct buf_readmode *mode) { return ioctl(fd, BUF_IOCSETREADMODE, mode); }
+int buf_get_readmode(int fd, struct buf_readmode *mode) { return ioctl(fd, BUF_IOCGETREADMODE, mode); }
+int buf_set_lanes(int fd, const struct buf_lanes *lanes) { return ioctl(fd, BUF_IOCSETLANES, lanes); }
+int buf_get_lanes(int fd, struct buf_lanes *lanes) { return ioctl(fd, BUF_IOCGETLANES, lanes); }
+int buf_set_lane(int fd, int lane) { return ioctl(fd, BUF_IOCSETLANE, &lane); }
+int buf_set_retain(int fd, int on) { return ioctl(fd, BUF_IOCSETRETAIN, &on); }
+int buf_get_seq(int fd, struct buf_seq *seq) { return ioctl(fd, BUF_IOCGETSEQ, seq); }
+int buf_set_autosize(int fd, const struct buf_autosize *policy) { return ioctl(fd, BUF_IOCSETAUTOSIZE, policy); }
+int buf_get_autosize(int fd, struct buf_autosize *policy) { return ioctl(fd, BUF_IOCGETAUTOSIZE, policy); }
+int buf_set_busypoll(int fd, int usec) { return ioctl(fd, BUF_IOCSETBUSYPOLL, &usec); }
+int buf_get_busypoll(int fd) { return get_int(fd, BUF_IOCGETBUSYPOLL); }
+int buf_set_wrbehind(int fd, unsigned int size) {
+    struct buf_wrbehind wb = { size, 0, 0 };
+    return ioctl(fd, BUF_IOCSETWRBEHIND, &wb);
+}
+int buf_get_wrbehind(int fd, struct buf_wrbehind *wb) { return ioctl(fd, BUF_IOCGETWRBEHIND, wb); }
+int buf_wrflush(int fd) { return ioctl(fd, BUF_IOCWRFLUSH); }
+int buf_set_rate(int fd, unsigned int rate, unsigned int burst) {
+    struct buf_ratelimit rl = { rate, burst, 0, 0 };
+    return ioctl(fd, BUF_IOCSETRATE, &rl);
+}
+int buf_get_rate(int fd, struct buf_ratelimit *rl) { return ioctl(fd, BUF_IOCGETRATE, rl); }
+int buf_set_devrate(int fd, unsigned int rate, unsigned int burst) {
+    struct buf_ratelimit rl = { rate, burst, 0, 0 };
+    return ioctl(fd, BUF_IOCSETDEVRATE, &rl);
+}
+int buf_get_devrate(int fd, struct buf_ratelimit *rl) { return ioctl(fd, BUF_IOCGETDEVRATE, rl); }
+
+/* --- Warm restart --- */
+void *buf_export(int fd, size_t *len) {
+    struct buf_image img = { 0, 0 };
+    void *image = NULL, *bigger;
+
+    // Ask for the size, then export; retry if writers made the image grow in between
+    while (ioctl(fd, BUF_IOCEXPORT, &img) < 0) {
+        if (errno != ENOSPC || !(bigger = realloc(image, img.len))) {
+            free(image);
+            return NULL;
+        }
+        image = bigger;
+        img.addr = (uintptr_t)image;
+    }
+    *len = img.len;
+    return image;
+}
+
+int buf_import(int fd, const void *image, size_t len) {
+    struct buf_image img = { (uintptr_t)image, len };
+    return ioctl(fd, BUF_IOCIMPORT, &img);
+}